@@ -1,63 +1,103 @@
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include "atomic_queue.h"
-#include "list.h"
+#include "envelop.h"
+#include "cache_line.h"
 
 /*
  * Atomic queue implementation - valid only for one producer and one consumer
  *
  * The queue stores envelops. These contain a pointer to the element enqueued
- * by the user and a struct list_head to keep the list pointers. When the
- * queue is first initialised it will contain an empty envelop, in which the
- * elem_ member points to NULL
+ * by the user and a pointer to the next envelop. The envelops form a single
+ * chain, from the oldest recycled envelop to the last pushed one:
  *
- * Atomic_queue_init(&q):
- *  +---------------------------------------+
- *  |                            env_1      |
- *  |                       +------------+  |
- *  |                       |    elem_---|--|-->NULL
- *  |                       |            |  |
- *  |       head_           |    head_   |  |
- *  |    +--------+         | +--------+ |  |
- *  +--->|  next  |---------|>|  next  |-|--+
- *       +--------+         | +--------+ |
- *  +----|  prev  |<--------|-|  prev  |<|--+
- *  |    +--------+         | +--------+ |  |
- *  |                       +------------+  |
- *  +---------------------------------------+
+ *     first_              head_                       tail_
+ *       |                   |                           |
+ *       v                   v                           v
+ *   +-------+   +-------+   +-------+   +-------+   +-------+
+ *   | env_1 |-->| env_2 |-->| env_3 |-->| env_4 |-->| env_5 |-->NULL
+ *   +-------+   +-------+   +-------+   +-------+   +-------+
+ *   \_______________________/ \_____________________________/
+ *     consumed, recycled by          queued elements
+ *     the producer                   (env_4, env_5)
  *
+ * head_ is owned by the consumer and points to the last consumed envelop,
+ * so that the front element is head_->next_->elem_ and the queue is empty
+ * when head_->next_ is NULL. When the queue is first initialised it contains
+ * a single empty envelop, pointed by first_, head_ and tail_.
  *
  * Atomic_queue_push(q, new):
- *                                                                    +-------+
- *                                           +----------------------->|  new  |
- *                                           |                        +-------+
- *  +----------------------------------------|-------------------+
- *  |                            env_1       |        env_2      |
- *  |                       +------------+   |   +------------+  |
- *  |                       |    elem_---|---+   |    elem_---|--|-->NULL
- *  |                       |            |       |            |  |
- *  |       head_           |    head_   |       |    head_   |  |
- *  |    +--------+         | +--------+ |       | +--------+ |  |
- *  +--->|  next  |---------|>|  next  |-|-------|>|  next  |-|--+
- *       +--------+         | +--------+ |       | +--------+ |
- *  +----|  prev  |<--------|-|  prev  |<|-------|-|  prev  |<|--+
- *  |    +--------+         | +--------+ |       | +--------+ |  |
- *  |                       +------------+       +------------+  |
- *  +------------------------------------------------------------+
+ *  - take the envelop at first_ if the consumer is done with it
+ *    (first_ != head_), otherwise malloc a new one
+ *  - env->elem_ = new, env->next_ = NULL
+ *  - tail_->next_ = env, with release semantics (publish)
+ *  - tail_ = env
  *
- *  A new Atomic_queue_pop(q) will remove env_1, that is:
- *   - q->head_.next     = env_2->head_
- *   - env_2->head_.prev = q->head_
+ * Atomic_queue_pop(q):
+ *  - head_ = head_->next_, with release semantics (hand back the envelop)
  *
- *  A concurrent Atomic_queue_push(q, new) will add a new envelop (env_3) and make
- *  env_2 elem_ point to 'new':
- *   - env_2->head_.next = env_3->head_
- *   - env_3->head_.pre  = env_2->head_
- *   - env_3->head_.next = q->head_
- *   - q->head_.prev     = env_3->head_
- *   - env_2->elem_      = new
+ * The producer writes only tail_, first_ and the next_ of the last
+ * envelop, the consumer writes only head_. The producer keeps a private
+ * copy of head_ (head_cache_) and reads the shared one only when it runs
+ * out of recycled envelops, so in steady state push does no malloc and
+ * pop does no free. Sizes are kept as two counters, each written by one
+ * side only, instead of a shared counter updated by both threads.
  *
- *  The push operation involves neither env_2->head_.prev nor
- *  head_.next (modified by the pop) and therefore does not produce
- *  any inconsistency in the queue.
+ * Atomic_queue_pop_wait(q, timeout) lets the consumer block instead of
+ * spinning on Atomic_queue_empty(): it spins SPIN_LIMIT times, yields
+ * YIELD_LIMIT times and then parks on a futex. Parking is a Dekker style
+ * handshake with the producer:
+ *
+ *    consumer                          producer
+ *    waiting_ = 1                      tail_->next_ = env
+ *    fence                             fence
+ *    if (empty) futex_wait(futex_)     if (waiting_) futex_++, futex_wake()
+ *
+ * so either the consumer sees the new envelop or the producer sees the
+ * consumer parked; the producer does the wake syscall only in the latter
+ * case. waiting_ and futex_ have their own cache line, written only when
+ * the consumer parks, so checking them does not bounce the consumer line.
+ *
+ * Event loop consumers use the same handshake with an eventfd instead of
+ * the futex: Atomic_queue_eventfd() creates it, to be registered with
+ * EPOLLIN | EPOLLET, and Atomic_queue_arm() is called before going back to
+ * epoll_wait(). It sets waiting_ to WAIT_EVENTFD and returns false if the
+ * queue is not empty after all; otherwise the next push writes the eventfd.
+ * A busy queue is never armed and its pushes do no syscall, an idle one
+ * costs nothing but its file descriptor.
+ *
+ * Batch operations pay the synchronisation once per batch:
+ * Atomic_queue_push_n() links the new envelops privately and publishes the
+ * whole chain with a single release store, Atomic_queue_pop_n() and
+ * Atomic_queue_drain() walk the published envelops and hand them back to
+ * the producer with a single release store of head_.
+ *
+ * pushed_ and popped_ fill in the pushes and pops of struct queue_stats
+ * (queue_stats.h) in any build. With ATOMIC_QUEUE_STATS defined the queue
+ * also keeps the other counters, push_full aside: being unbounded it is
+ * never full. Producer and consumer counters are on separate cache lines
+ * and each is written by its own side only, with plain relaxed stores, so
+ * Atomic_queue_stats() can read them from any thread without stopping the
+ * queue; a snapshot is not atomic as a whole.
+ * One push out of QUEUE_STATS_SAMPLE samples the occupancy and stamps its
+ * envelop, the consumer turns the stamp into a latency when it pops it.
+ *
+ * Envelops are recycled by the queue itself, elements are up to the user.
+ * A slab (slab.c) created by the producer thread and attached with
+ * Atomic_queue_attach_slab() keeps them off malloc too: the producer gets
+ * elements with Atomic_queue_alloc(), the consumer releases them with
+ * Atomic_queue_free(), which returns them to the producer in batches.
+ * Slab_free() finds the slab from the address alone, so with a slab
+ * attached every element pushed must come from Atomic_queue_alloc(). The
+ * consumer flushes its pending batch before parking or arming, so that an
+ * idle consumer does not sit on objects the producer could reuse.
  */
 
 #define CHECK_PTR(ptr)           \
@@ -66,107 +106,558 @@
                         return;  \
         } while(0)
 
+#define SPIN_LIMIT  256
+#define YIELD_LIMIT 16
+
+/* how the consumer waits, value of waiting_ */
+#define WAIT_FUTEX   1
+#define WAIT_EVENTFD 2
+
+#ifdef ATOMIC_QUEUE_STATS
+/* single writer counters: no read-modify-write needed */
+#define STAT_ADD(counter, n)                                                        \
+        atomic_store_explicit(&(counter),                                           \
+                              atomic_load_explicit(&(counter), memory_order_relaxed) + (n), \
+                              memory_order_relaxed)
+
+struct producer_stats {
+
+        _Atomic unsigned long allocs_;
+        _Atomic unsigned long wakes_;
+        _Atomic unsigned long high_water_;
+        _Atomic unsigned long occupancy_[QUEUE_STATS_BUCKETS];
+} __cache_aligned;
+
+struct consumer_stats {
+
+        _Atomic unsigned long pop_empty_;
+        _Atomic unsigned long spins_;
+        _Atomic unsigned long yields_;
+        _Atomic unsigned long parks_;
+        _Atomic unsigned long latency_samples_;
+        _Atomic unsigned long latency_max_;
+        _Atomic unsigned long latency_sum_;
+        _Atomic unsigned long latency_[QUEUE_STATS_BUCKETS];
+} __cache_aligned;
+#endif
+
 struct atomic_queue {
 
-        struct list_head head_;
-        int size_;
+        /* consumer side */
+        struct envelop *_Atomic head_ __cache_aligned;
+        _Atomic unsigned long popped_;
+
+        /* producer side */
+        struct envelop *tail_ __cache_aligned;
+        struct envelop *first_;
+        struct envelop *head_cache_;
+        _Atomic unsigned long pushed_;
+
+        /* parking side */
+        _Atomic int waiting_ __cache_aligned;
+        _Atomic unsigned int futex_;
+        int eventfd_;
+        bool written_;   /* consumer: the producer took the last arm */
+        slab_t slab_;    /* elements, set before use and read only */
+
+#ifdef ATOMIC_QUEUE_STATS
+        struct producer_stats pstats_;
+        struct consumer_stats cstats_;
+#endif
 };
 
+#ifdef ATOMIC_QUEUE_STATS
+static int log2_bucket(unsigned long v) {
+
+        int b = v ? 64 - __builtin_clzl(v) : 0;
+
+        return (b < QUEUE_STATS_BUCKETS) ? b : QUEUE_STATS_BUCKETS - 1;
+}
+
+static uint64_t now_ns(void) {
+
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* called by the producer on the n-th envelop of a push, before publishing */
+static void stat_push(atomic_queue_t q, struct envelop *env, unsigned long n) {
+
+        unsigned long pushed = atomic_load_explicit(&q->pushed_, memory_order_relaxed) + n;
+        unsigned long occupancy;
+
+        env->stamp_ = 0;
+        if (pushed % QUEUE_STATS_SAMPLE)
+                return;
+
+        env->stamp_ = now_ns();
+
+        occupancy = pushed - atomic_load_explicit(&q->popped_, memory_order_relaxed);
+        STAT_ADD(q->pstats_.occupancy_[log2_bucket(occupancy)], 1);
+        if (occupancy > atomic_load_explicit(&q->pstats_.high_water_, memory_order_relaxed))
+                atomic_store_explicit(&q->pstats_.high_water_, occupancy, memory_order_relaxed);
+}
+
+/* called by the consumer on every popped envelop */
+static void stat_pop(atomic_queue_t q, struct envelop *env) {
+
+        unsigned long latency;
+
+        if (env->stamp_ == 0)
+                return;
+
+        latency = now_ns() - env->stamp_;
+        STAT_ADD(q->cstats_.latency_samples_, 1);
+        STAT_ADD(q->cstats_.latency_sum_, latency);
+        STAT_ADD(q->cstats_.latency_[log2_bucket(latency)], 1);
+        if (latency > atomic_load_explicit(&q->cstats_.latency_max_, memory_order_relaxed))
+                atomic_store_explicit(&q->cstats_.latency_max_, latency, memory_order_relaxed);
+}
+#endif
+
+/* wake the consumer if it is parked or armed */
+static void wake_consumer(atomic_queue_t q) {
+
+        uint64_t one = 1;
+        int waiting;
+
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (atomic_load_explicit(&q->waiting_, memory_order_relaxed) == 0)
+                return;
+
+        waiting = atomic_exchange_explicit(&q->waiting_, 0, memory_order_acquire);
+        if (waiting == WAIT_FUTEX) {
+                atomic_fetch_add_explicit(&q->futex_, 1, memory_order_release);
+                syscall(SYS_futex, (uint32_t *)&q->futex_, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+                QUEUE_STAT(STAT_ADD(q->pstats_.wakes_, 1));
+        } else if (waiting == WAIT_EVENTFD) {
+                if (write(q->eventfd_, &one, sizeof(one)) < 0)
+                        return;
+                QUEUE_STAT(STAT_ADD(q->pstats_.wakes_, 1));
+        }
+}
+
+static long long now_us(void) {
+
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* get an envelop from the consumed ones or malloc a new one */
+static struct envelop *alloc_envelop(atomic_queue_t q) {
+
+        struct envelop *env;
+
+        if (q->first_ == q->head_cache_)
+                q->head_cache_ = atomic_load_explicit(&q->head_, memory_order_acquire);
+
+        if (q->first_ != q->head_cache_) {
+                env = q->first_;
+                q->first_ = atomic_load_explicit(&env->next_, memory_order_relaxed);
+                return env;
+        }
+
+        QUEUE_STAT(STAT_ADD(q->pstats_.allocs_, 1));
+        return (struct envelop *)malloc(sizeof(struct envelop));
+}
+
 void Atomic_queue_init(atomic_queue_t *q) {
 
         struct envelop *empty;
-        *q = (struct atomic_queue *)malloc(sizeof(struct atomic_queue));
-        INIT_LIST_HEAD(&((*q)->head_));
+        void *ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct atomic_queue))) {
+                *q = NULL;
+                return;
+        }
+        *q = (struct atomic_queue *)ptr;
 
         /* add empty envelop */
-        empty = (struct envelop*)malloc(sizeof(struct envelop));
-        list_add_tail(&(empty->head_), &(*q)->head_);
-        (*q)->size_ = 0;
+        empty = (struct envelop *)malloc(sizeof(struct envelop));
+        empty->elem_ = NULL;
+        atomic_init(&empty->next_, NULL);
+
+        atomic_init(&(*q)->head_, empty);
+        atomic_init(&(*q)->popped_, 0);
+        (*q)->tail_ = empty;
+        (*q)->first_ = empty;
+        (*q)->head_cache_ = empty;
+        atomic_init(&(*q)->pushed_, 0);
+        atomic_init(&(*q)->waiting_, 0);
+        atomic_init(&(*q)->futex_, 0);
+        (*q)->eventfd_ = -1;
+        (*q)->written_ = false;
+        (*q)->slab_ = NULL;
+        QUEUE_STAT(memset(&(*q)->pstats_, 0, sizeof((*q)->pstats_)));
+        QUEUE_STAT(memset(&(*q)->cstats_, 0, sizeof((*q)->cstats_)));
 }
 
 void Atomic_queue_fini(atomic_queue_t *q) {
 
-        struct envelop *env;
+        struct envelop *env, *next;
 
         CHECK_PTR(*q);
 
-        /* free dummy element */
-        env = list_entry((*q)->head_.prev, struct envelop, head_);
-        free(env);
+        /* free recycled, dummy and queued envelops */
+        for (env = (*q)->first_; env != NULL; env = next) {
+                next = atomic_load_explicit(&env->next_, memory_order_relaxed);
+                free(env);
+        }
+
+        if ((*q)->eventfd_ >= 0)
+                close((*q)->eventfd_);
 
         /* free queue */
         free(*q);
+        *q = NULL;
 }
 
 void Atomic_queue_push(atomic_queue_t q, void *elem) {
 
-        struct envelop *empty;
+        struct envelop *env;
+        unsigned long pushed;
 
         CHECK_PTR(q);
 
-        /* alloc mem for new envelop */
-        empty = (struct envelop *)malloc(sizeof(struct envelop));
+        env = alloc_envelop(q);
+        env->elem_ = elem;
+        atomic_store_explicit(&env->next_, NULL, memory_order_relaxed);
+        QUEUE_STAT(stat_push(q, env, 1));
+
+        /* publish the envelop to the consumer */
+        atomic_store_explicit(&q->tail_->next_, env, memory_order_release);
+        q->tail_ = env;
+
+        /* update size */
+        pushed = atomic_load_explicit(&q->pushed_, memory_order_relaxed);
+        atomic_store_explicit(&q->pushed_, pushed + 1, memory_order_relaxed);
+
+        wake_consumer(q);
+}
+
+void Atomic_queue_push_n(atomic_queue_t q, void **elems, int n) {
 
-        /* add empty envelop at the tail of the list */
-        list_add_tail(&(empty->head_), &(q->head_));
+        struct envelop *first, *last, *env;
+        unsigned long pushed;
+        int i;
+
+        if ((q == NULL) || (n <= 0))
+                return;
 
-        /* get oldest empty envelop */
-        empty = list_entry(q->head_.prev->prev, struct envelop, head_);
+        /* build the chain privately */
+        first = last = alloc_envelop(q);
+        first->elem_ = elems[0];
+        QUEUE_STAT(stat_push(q, first, 1));
+        for (i = 1; i < n; i++) {
+                env = alloc_envelop(q);
+                env->elem_ = elems[i];
+                QUEUE_STAT(stat_push(q, env, i + 1));
+                atomic_store_explicit(&last->next_, env, memory_order_relaxed);
+                last = env;
+        }
+        atomic_store_explicit(&last->next_, NULL, memory_order_relaxed);
+
+        /* publish the whole chain to the consumer */
+        atomic_store_explicit(&q->tail_->next_, first, memory_order_release);
+        q->tail_ = last;
 
-        /* update pointer to element */
-        empty->elem_ = elem;
+        /* update size */
+        pushed = atomic_load_explicit(&q->pushed_, memory_order_relaxed);
+        atomic_store_explicit(&q->pushed_, pushed + n, memory_order_relaxed);
 
-        /* updated size */
-        q->size_++;
+        wake_consumer(q);
+}
+
+/* walk up to max published envelops, then hand them back at once */
+static int pop_chain(atomic_queue_t q, void **elems, void (*function)(void *), unsigned long max) {
+
+        struct envelop *head, *next;
+        unsigned long popped, i;
+
+        head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        for (i = 0; i < max; i++) {
+                next = atomic_load_explicit(&head->next_, memory_order_acquire);
+                if (next == NULL)
+                        break;
+                QUEUE_STAT(stat_pop(q, next));
+                if (elems)
+                        elems[i] = next->elem_;
+                else
+                        function(next->elem_);
+                head = next;
+        }
+
+        if (i == 0) {
+                QUEUE_STAT(STAT_ADD(q->cstats_.pop_empty_, 1));
+                return 0;
+        }
+
+        atomic_store_explicit(&q->head_, head, memory_order_release);
+
+        /* update size */
+        popped = atomic_load_explicit(&q->popped_, memory_order_relaxed);
+        atomic_store_explicit(&q->popped_, popped + i, memory_order_relaxed);
+
+        return (int)i;
+}
+
+int Atomic_queue_pop_n(atomic_queue_t q, void **elems, int max) {
+
+        if ((q == NULL) || (max <= 0))
+                return 0;
+
+        return pop_chain(q, elems, NULL, max);
+}
+
+int Atomic_queue_drain(atomic_queue_t q, void (*function)(void *)) {
+
+        unsigned long pushed, popped;
+
+        if (q == NULL)
+                return 0;
+
+        /* take the backlog as of now, not what is pushed meanwhile */
+        pushed = atomic_load_explicit(&q->pushed_, memory_order_relaxed);
+        popped = atomic_load_explicit(&q->popped_, memory_order_relaxed);
+
+        return pop_chain(q, NULL, function, pushed - popped);
 }
 
 void Atomic_queue_pop(atomic_queue_t q) {
 
+        struct envelop *head, *next;
+        unsigned long popped;
+
         CHECK_PTR(q);
 
+        head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        next = atomic_load_explicit(&head->next_, memory_order_acquire);
+
         /* if empty return */
-        if (Atomic_queue_empty(q))
+        if (next == NULL) {
+                QUEUE_STAT(STAT_ADD(q->cstats_.pop_empty_, 1));
                 return;
+        }
+        QUEUE_STAT(stat_pop(q, next));
 
-        /* pop element */
-        list_del(q->head_.next);
+        /* pop element, head becomes the new dummy envelop */
+        atomic_store_explicit(&q->head_, next, memory_order_release);
 
         /* update size */
-        q->size_--;
+        popped = atomic_load_explicit(&q->popped_, memory_order_relaxed);
+        atomic_store_explicit(&q->popped_, popped + 1, memory_order_relaxed);
+}
+
+void *Atomic_queue_pop_wait(atomic_queue_t q, long timeout) {
+
+        long long deadline = 0, left;
+        struct timespec ts;
+        unsigned int seq;
+        void *elem;
+        int spins;
+
+        if (q == NULL)
+                return NULL;
+
+        if (timeout > 0)
+                deadline = now_us() + timeout;
+
+        for (spins = 0; ; spins++) {
+                if (!Atomic_queue_empty(q)) {
+                        elem = Atomic_queue_front(q);
+                        Atomic_queue_pop(q);
+                        return elem;
+                }
+
+                if (timeout == 0) {
+                        QUEUE_STAT(STAT_ADD(q->cstats_.pop_empty_, 1));
+                        return NULL;
+                }
+
+                /* spin, then yield */
+                if (spins < SPIN_LIMIT) {
+                        QUEUE_STAT(STAT_ADD(q->cstats_.spins_, 1));
+                        cpu_relax();
+                        continue;
+                }
+                if ((timeout > 0) && (now_us() >= deadline))
+                        return NULL;
+                if (spins < SPIN_LIMIT + YIELD_LIMIT) {
+                        QUEUE_STAT(STAT_ADD(q->cstats_.yields_, 1));
+                        sched_yield();
+                        continue;
+                }
+
+                /* then park, returning freed elements first */
+                if (q->slab_ != NULL)
+                        Slab_flush(q->slab_);
+                seq = atomic_load_explicit(&q->futex_, memory_order_acquire);
+                atomic_store_explicit(&q->waiting_, WAIT_FUTEX, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+
+                if (Atomic_queue_empty(q)) {
+                        if (timeout > 0) {
+                                left = deadline - now_us();
+                                if (left <= 0) {
+                                        atomic_store_explicit(&q->waiting_, 0, memory_order_relaxed);
+                                        return NULL;
+                                }
+                                ts.tv_sec = left / 1000000;
+                                ts.tv_nsec = (left % 1000000) * 1000;
+                        }
+                        QUEUE_STAT(STAT_ADD(q->cstats_.parks_, 1));
+                        syscall(SYS_futex, (uint32_t *)&q->futex_, FUTEX_WAIT_PRIVATE, seq,
+                                (timeout > 0) ? &ts : NULL, NULL, 0);
+                }
+
+                atomic_store_explicit(&q->waiting_, 0, memory_order_relaxed);
+        }
+}
+
+int Atomic_queue_eventfd(atomic_queue_t q) {
+
+        if (q == NULL)
+                return -1;
+
+        /* created by the consumer before it first arms the queue */
+        if (q->eventfd_ < 0)
+                q->eventfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        return q->eventfd_;
+}
+
+bool Atomic_queue_arm(atomic_queue_t q) {
+
+        uint64_t count;
+
+        if ((q == NULL) || (q->eventfd_ < 0))
+                return false;
+
+        /* reset the counter if the producer wrote it since the last arm */
+        if (q->written_) {
+                if (read(q->eventfd_, &count, sizeof(count)) < 0)
+                        count = 0;
+                q->written_ = false;
+        }
+
+        if (q->slab_ != NULL)
+                Slab_flush(q->slab_);
+
+        atomic_store_explicit(&q->waiting_, WAIT_EVENTFD, memory_order_release);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (!Atomic_queue_empty(q)) {
+                /* lost the race: the producer took the arm and writes the eventfd */
+                if (atomic_exchange_explicit(&q->waiting_, 0, memory_order_relaxed) == 0)
+                        q->written_ = true;
+                return false;
+        }
+
+        q->written_ = true;
+        return true;
 }
 
 int Atomic_queue_size(atomic_queue_t q) {
 
-        return q->size_;
+        unsigned long popped = atomic_load_explicit(&q->popped_, memory_order_relaxed);
+        unsigned long pushed = atomic_load_explicit(&q->pushed_, memory_order_relaxed);
+
+        /* counters are read one after the other, never report less than 0 */
+        return (pushed > popped) ? (int)(pushed - popped) : 0;
 }
 
 bool Atomic_queue_empty(atomic_queue_t q) {
 
-        return (q->size_ > 0) ? false : true;
+        struct envelop *head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+
+        return atomic_load_explicit(&head->next_, memory_order_acquire) == NULL;
 }
 
 void *Atomic_queue_front(atomic_queue_t q) {
 
-        struct envelop *env;
+        struct envelop *head, *next;
+
+        head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        next = atomic_load_explicit(&head->next_, memory_order_acquire);
 
         /* if empty return NULL */
-        if (Atomic_queue_empty(q))
+        if (next == NULL)
                 return NULL;
 
         /* return the front element */
-        env = list_entry(q->head_.next, struct envelop, head_);
-        return env->elem_;
+        return next->elem_;
 }
 
 void *Atomic_queue_back(atomic_queue_t q) {
 
-        struct envelop *env;
+        /* called by the producer: empty if the consumer caught up */
+        if (q->tail_ == atomic_load_explicit(&q->head_, memory_order_acquire))
+                return NULL;
 
-        /* if empty return NULL */
-        if (Atomic_queue_empty(q))
+        /* return the back element */
+        return q->tail_->elem_;
+}
+
+void Atomic_queue_stats(atomic_queue_t q, struct queue_stats *stats) {
+
+#ifdef ATOMIC_QUEUE_STATS
+        int i;
+#endif
+
+        memset(stats, 0, sizeof(*stats));
+        CHECK_PTR(q);
+
+        stats->pushes = atomic_load_explicit(&q->pushed_, memory_order_relaxed);
+        stats->pops = atomic_load_explicit(&q->popped_, memory_order_relaxed);
+
+#ifdef ATOMIC_QUEUE_STATS
+        /* unbounded: pushes never find the queue full, they allocate */
+        stats->allocs = atomic_load_explicit(&q->pstats_.allocs_, memory_order_relaxed);
+        stats->wakes = atomic_load_explicit(&q->pstats_.wakes_, memory_order_relaxed);
+        stats->high_water = atomic_load_explicit(&q->pstats_.high_water_, memory_order_relaxed);
+        stats->pop_empty = atomic_load_explicit(&q->cstats_.pop_empty_, memory_order_relaxed);
+        stats->spins = atomic_load_explicit(&q->cstats_.spins_, memory_order_relaxed);
+        stats->yields = atomic_load_explicit(&q->cstats_.yields_, memory_order_relaxed);
+        stats->parks = atomic_load_explicit(&q->cstats_.parks_, memory_order_relaxed);
+        stats->latency_samples = atomic_load_explicit(&q->cstats_.latency_samples_, memory_order_relaxed);
+        stats->latency_max_ns = atomic_load_explicit(&q->cstats_.latency_max_, memory_order_relaxed);
+        stats->latency_sum_ns = atomic_load_explicit(&q->cstats_.latency_sum_, memory_order_relaxed);
+        for (i = 0; i < QUEUE_STATS_BUCKETS; i++) {
+                stats->occupancy[i] = atomic_load_explicit(&q->pstats_.occupancy_[i], memory_order_relaxed);
+                stats->latency[i] = atomic_load_explicit(&q->cstats_.latency_[i], memory_order_relaxed);
+        }
+#endif
+}
+
+void Atomic_queue_attach_slab(atomic_queue_t q, slab_t slab) {
+
+        CHECK_PTR(q);
+
+        /* before the queue is shared with the consumer */
+        q->slab_ = slab;
+}
+
+void *Atomic_queue_alloc(atomic_queue_t q) {
+
+        /* producer only, NULL without a slab */
+        if (q == NULL)
                 return NULL;
 
-        /* return the front element */
-        env = list_entry(q->head_.prev, struct envelop, head_);
-        return env->elem_;
+        return Slab_alloc(q->slab_);
+}
+
+void Atomic_queue_free(atomic_queue_t q, void *elem) {
+
+        CHECK_PTR(q);
+
+        /* consumer, or anyone once the element left the queue */
+        if (q->slab_ != NULL)
+                Slab_free(elem);
+        else
+                free(elem);
 }
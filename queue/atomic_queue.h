@@ -1,7 +1,8 @@
 #ifndef __ATOMIC_QUEUE_H__
 #define __ATOMIC_QUEUE_H__
 
-#include "envelop.h"
+#include "queue_stats.h"
+#include "slab.h"
 #include <stdbool.h>
 #include <stdlib.h>
 
@@ -10,9 +11,25 @@ typedef struct atomic_queue *atomic_queue_t;
 void Atomic_queue_init(atomic_queue_t *);
 void Atomic_queue_fini(atomic_queue_t *);
 void Atomic_queue_push(atomic_queue_t, void *);
+void Atomic_queue_push_n(atomic_queue_t, void **, int);
 void Atomic_queue_pop(atomic_queue_t);
+int  Atomic_queue_pop_n(atomic_queue_t, void **, int);
+int  Atomic_queue_drain(atomic_queue_t, void (*)(void *));
+void *Atomic_queue_pop_wait(atomic_queue_t, long);
+int  Atomic_queue_eventfd(atomic_queue_t);
+bool Atomic_queue_arm(atomic_queue_t);
 int  Atomic_queue_size(atomic_queue_t);
 bool Atomic_queue_empty(atomic_queue_t);
 void *Atomic_queue_front(atomic_queue_t);
 void *Atomic_queue_back(atomic_queue_t);
+void Atomic_queue_stats(atomic_queue_t, struct queue_stats *);
+
+/*
+ * once a slab is attached Atomic_queue_free() passes every element to
+ * Slab_free(), so all elements must come from Atomic_queue_alloc(): one
+ * from malloc() would be taken for a slab object and corrupt the slab
+ */
+void Atomic_queue_attach_slab(atomic_queue_t, slab_t);
+void *Atomic_queue_alloc(atomic_queue_t);
+void Atomic_queue_free(atomic_queue_t, void *);
 #endif
@@ -0,0 +1,208 @@
+#ifndef __ATOMIC_QUEUE_HPP__
+#define __ATOMIC_QUEUE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "cache_line.h"
+
+namespace queues {
+
+        /*
+         * Typed atomic queue - valid only for one producer and one consumer
+         *
+         * C++ counterpart of atomic_queue.c storing the elements by value
+         * instead of void pointers, so that small messages never touch the
+         * heap. Elements are constructed in place (emplace) in blocks of
+         * BLOCK slots chained from the oldest recycled block to the one the
+         * producer is filling:
+         *
+         *     first_            head_                 tail_
+         *       |                 |                     |
+         *       v                 v                     v
+         *   +-------+   +-------+   +-------+   +-------+
+         *   | done  |-->| done  |-->| x x x |-->| x x   |-->NULL
+         *   +-------+   +-------+   +-------+   +-------+
+         *                              ^           ^
+         *                            read_       write_
+         *
+         * pushed_ and popped_ count the elements, each written by one side
+         * only with release semantics; a slot is visible to the consumer
+         * once pushed_ went past it. The producer reuses the block at first_
+         * once popped_ shows the consumer has moved to the following one,
+         * so in steady state push does no new and pop does no delete.
+         *
+         * Types that can be neither copied nor moved are still supported
+         * through emplace() and front(); tryPop() needs a movable type.
+         */
+        template <typename T, size_t BLOCK = 64> class AtomicQueue {
+
+                private:
+                        struct Block {
+                                alignas(T) unsigned char slots_[BLOCK][sizeof(T)];
+                                Block *next_;
+
+                                T *slot(size_t i) {
+                                        return reinterpret_cast<T *>(slots_[i]);
+                                }
+                        };
+
+                        /* consumer line */
+                        alignas(CACHE_LINE_SIZE) Block *head_;
+                        size_t read_;
+                        size_t pushedCache_;
+                        std::atomic<size_t> popped_;
+
+                        /* producer line */
+                        alignas(CACHE_LINE_SIZE) Block *tail_;
+                        Block *first_;
+                        size_t write_;
+                        size_t firstSeq_;
+                        size_t poppedCache_;
+                        std::atomic<size_t> pushed_;
+
+                        /* take a block the consumer is done with, or allocate one */
+                        Block *getBlock() {
+                                Block *block;
+
+                                if (poppedCache_ <= firstSeq_ + BLOCK)
+                                        poppedCache_ = popped_.load(std::memory_order_acquire);
+
+                                if (poppedCache_ > firstSeq_ + BLOCK) {
+                                        block = first_;
+                                        first_ = first_->next_;
+                                        firstSeq_ += BLOCK;
+                                } else {
+                                        block = new Block;
+                                }
+                                block->next_ = NULL;
+                                return block;
+                        }
+
+                        /* slot of the front element, NULL if empty */
+                        T *frontSlot() {
+                                size_t popped = popped_.load(std::memory_order_relaxed);
+
+                                if (popped == pushedCache_) {
+                                        pushedCache_ = pushed_.load(std::memory_order_acquire);
+                                        if (popped == pushedCache_)
+                                                return NULL;
+                                }
+
+                                if (read_ == BLOCK) {
+                                        head_ = head_->next_;
+                                        read_ = 0;
+                                }
+                                return head_->slot(read_);
+                        }
+
+                public:
+                        /* default constructor */
+                        AtomicQueue() {
+                                head_ = tail_ = first_ = new Block;
+                                head_->next_ = NULL;
+                                read_ = write_ = 0;
+                                firstSeq_ = 0;
+                                pushedCache_ = poppedCache_ = 0;
+                                popped_.store(0, std::memory_order_relaxed);
+                                pushed_.store(0, std::memory_order_relaxed);
+                        }
+
+                        AtomicQueue(const AtomicQueue &) = delete;
+                        AtomicQueue &operator=(const AtomicQueue &) = delete;
+
+                        /* destructor: destroy queued elements and free blocks */
+                        ~AtomicQueue() {
+                                Block *next;
+
+                                while (!empty())
+                                        pop();
+
+                                while (first_ != NULL) {
+                                        next = first_->next_;
+                                        delete first_;
+                                        first_ = next;
+                                }
+                        }
+
+                        /* construct a new element at the back, producer only */
+                        template <typename... ARGS> void emplace(ARGS &&... args) {
+                                Block *block;
+
+                                if (write_ == BLOCK) {
+                                        block = getBlock();
+                                        tail_->next_ = block;
+                                        tail_ = block;
+                                        write_ = 0;
+                                }
+
+                                new (tail_->slot(write_)) T(std::forward<ARGS>(args)...);
+                                write_++;
+
+                                /* publish */
+                                pushed_.store(pushed_.load(std::memory_order_relaxed) + 1,
+                                              std::memory_order_release);
+                        }
+
+                        /* copy an element at the back, producer only */
+                        void push(const T &elem) {
+                                emplace(elem);
+                        }
+
+                        /* move an element at the back, producer only */
+                        void push(T &&elem) {
+                                emplace(std::move(elem));
+                        }
+
+                        /* front element, consumer only, queue must not be empty */
+                        T &front() {
+                                return *frontSlot();
+                        }
+
+                        /* last pushed element, producer only, queue must not be empty */
+                        T &back() {
+                                return *tail_->slot(write_ - 1);
+                        }
+
+                        /* destroy the front element, consumer only */
+                        void pop() {
+                                T *elem = frontSlot();
+
+                                if (elem == NULL)
+                                        return;
+
+                                elem->~T();
+                                read_++;
+
+                                /* hand the slot back to the producer */
+                                popped_.store(popped_.load(std::memory_order_relaxed) + 1,
+                                              std::memory_order_release);
+                        }
+
+                        /* move the front element out and pop it, false if empty */
+                        bool tryPop(T &elem) {
+                                T *front = frontSlot();
+
+                                if (front == NULL)
+                                        return false;
+
+                                elem = std::move(*front);
+                                pop();
+                                return true;
+                        }
+
+                        /* number of queued elements */
+                        size_t size() const {
+                                size_t popped = popped_.load(std::memory_order_acquire);
+
+                                return pushed_.load(std::memory_order_acquire) - popped;
+                        }
+
+                        /* is the queue empty? */
+                        bool empty() const {
+                                return size() == 0;
+                        }
+        };
+}
+#endif
@@ -0,0 +1,224 @@
+#ifndef __ATOMIC_QUEUE_CORO_HPP__
+#define __ATOMIC_QUEUE_CORO_HPP__
+
+#include <cerrno>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <system_error>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+extern "C" {
+#include "atomic_queue.h"
+}
+
+namespace queues {
+
+        /*
+         * Single threaded epoll executor. Coroutines waiting on a file
+         * descriptor are resumed from run(), on the thread calling it,
+         * when the descriptor becomes readable. Descriptors are registered
+         * edge triggered.
+         */
+        class Executor {
+
+                private:
+                        int epfd_;
+                        bool stop_;
+                        std::deque<std::coroutine_handle<>> ready_;
+                        std::unordered_map<int, std::function<void()>> watched_;
+
+                public:
+                        /* default constructor, throws std::system_error without epoll */
+                        Executor() {
+                                epfd_ = epoll_create1(EPOLL_CLOEXEC);
+                                if (epfd_ < 0)
+                                        throw std::system_error(errno, std::system_category(), "epoll_create1");
+                                stop_ = false;
+                        }
+
+                        Executor(const Executor &) = delete;
+                        Executor &operator=(const Executor &) = delete;
+
+                        /* destructor */
+                        ~Executor() {
+                                close(epfd_);
+                        }
+
+                        /* resume h at the next iteration of run() */
+                        void post(std::coroutine_handle<> h) {
+                                ready_.push_back(h);
+                        }
+
+                        /* call ready whenever fd becomes readable */
+                        bool watch(int fd, std::function<void()> ready) {
+                                struct epoll_event ev;
+
+                                ev.events = EPOLLIN | EPOLLET;
+                                ev.data.fd = fd;
+                                if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+                                        return false;
+
+                                watched_[fd] = std::move(ready);
+                                return true;
+                        }
+
+                        /* stop watching fd */
+                        void unwatch(int fd) {
+                                epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, NULL);
+                                watched_.erase(fd);
+                        }
+
+                        /* make run() return */
+                        void stop() {
+                                stop_ = true;
+                        }
+
+                        /* run posted coroutines, then sleep in epoll until stop() */
+                        void run() {
+                                struct epoll_event events[64];
+                                std::coroutine_handle<> h;
+                                int i, n;
+
+                                stop_ = false;
+                                while (!stop_) {
+                                        while (!ready_.empty() && !stop_) {
+                                                h = ready_.front();
+                                                ready_.pop_front();
+                                                h.resume();
+                                        }
+                                        if (stop_)
+                                                break;
+
+                                        n = epoll_wait(epfd_, events, 64, -1);
+                                        for (i = 0; i < n; i++) {
+                                                auto it = watched_.find(events[i].data.fd);
+                                                if (it != watched_.end())
+                                                        it->second();
+                                        }
+                                }
+                        }
+        };
+
+        /*
+         * Atomic queue (atomic_queue.c) whose consumer is a coroutine
+         * running on an Executor: co_await q.pop() returns the front
+         * element right away if there is one, otherwise arms the queue
+         * eventfd and suspends until a push writes it. Pushes may come
+         * from any one producer thread; as long as the consumer keeps up
+         * they find the queue unarmed and make no syscall.
+         */
+        class AwaitableQueue {
+
+                private:
+                        atomic_queue_t q_;
+                        Executor &executor_;
+                        int eventfd_;
+                        std::coroutine_handle<> waiter_;
+
+                        /* eventfd readable: resume the waiter if there is data */
+                        void ready() {
+                                std::coroutine_handle<> h = waiter_;
+
+                                if (!h)
+                                        return;
+
+                                /* spurious: arm again and keep sleeping */
+                                if (Atomic_queue_empty(q_) && Atomic_queue_arm(q_))
+                                        return;
+
+                                waiter_ = nullptr;
+                                h.resume();
+                        }
+
+                public:
+                        struct PopAwaiter {
+                                AwaitableQueue &queue_;
+
+                                bool await_ready() {
+                                        return !Atomic_queue_empty(queue_.q_);
+                                }
+
+                                bool await_suspend(std::coroutine_handle<> h) {
+                                        /* data arrived while arming: do not suspend */
+                                        if (!Atomic_queue_arm(queue_.q_))
+                                                return false;
+
+                                        queue_.waiter_ = h;
+                                        return true;
+                                }
+
+                                /*
+                                 * resumed only once the queue has data, so this
+                                 * returns at once; should that ever not hold it
+                                 * waits for the element rather than return one
+                                 * it never saw
+                                 */
+                                void *await_resume() {
+                                        return Atomic_queue_pop_wait(queue_.q_, -1);
+                                }
+                        };
+
+                        /*
+                         * constructor: consumer side runs on executor; throws
+                         * std::system_error if the queue, its eventfd or the
+                         * epoll registration cannot be set up
+                         */
+                        AwaitableQueue(Executor &executor) : executor_(executor) {
+                                int error;
+
+                                Atomic_queue_init(&q_);
+                                if (q_ == NULL)
+                                        throw std::system_error(ENOMEM, std::system_category(), "Atomic_queue_init");
+
+                                eventfd_ = Atomic_queue_eventfd(q_);
+                                if ((eventfd_ < 0) || !executor_.watch(eventfd_, [this]() { ready(); })) {
+                                        error = errno;
+                                        Atomic_queue_fini(&q_);
+                                        throw std::system_error(error, std::system_category(), "AwaitableQueue");
+                                }
+                        }
+
+                        AwaitableQueue(const AwaitableQueue &) = delete;
+                        AwaitableQueue &operator=(const AwaitableQueue &) = delete;
+
+                        /* destructor */
+                        ~AwaitableQueue() {
+                                executor_.unwatch(eventfd_);
+                                Atomic_queue_fini(&q_);
+                        }
+
+                        /* push an element, producer only */
+                        void push(void *elem) {
+                                Atomic_queue_push(q_, elem);
+                        }
+
+                        /* co_await pop(): front element, consumer only */
+                        PopAwaiter pop() {
+                                return PopAwaiter{*this};
+                        }
+
+                        /* underlying C queue */
+                        atomic_queue_t get() {
+                                return q_;
+                        }
+        };
+
+        /*
+         * Minimal eagerly started, detached coroutine type for consumer
+         * loops: for (;;) { void *e = co_await q.pop(); ... }
+         */
+        struct Task {
+                struct promise_type {
+                        Task get_return_object() { return Task(); }
+                        std::suspend_never initial_suspend() noexcept { return {}; }
+                        std::suspend_never final_suspend() noexcept { return {}; }
+                        void return_void() {}
+                        void unhandled_exception() { std::terminate(); }
+                };
+        };
+}
+#endif
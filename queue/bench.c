@@ -0,0 +1,1089 @@
+/*
+ * Throughput and latency benchmark for the queues
+ *
+ * Every queue is driven through a small adapter (push n messages, pop up to
+ * n messages) under the same scenario:
+ *
+ *   producers : threads pushing --messages messages each
+ *   consumers : threads popping until every message has been received
+ *   size      : message size in bytes, header included
+ *   batch     : messages per push/pop call, using the batch operations of
+ *               the queue where it has them
+ *   pin       : where threads run
+ *                 none   : wherever the scheduler puts them
+ *                 same   : all on the same cpu
+ *                 smt    : producer and consumer on SMT siblings of a core
+ *                 core   : on different cores of the same socket
+ *                 socket : producers on one socket, consumers on another
+ *
+ * Messages are preallocated per producer, so the allocator stays out of the
+ * measure. Queues of pointers carry pointers to them, the broadcast ring
+ * and the shared memory queue copy them in and out of their slots. Each
+ * message is stamped before it is pushed and compared with the clock when
+ * it is popped, with clock_gettime(CLOCK_MONOTONIC) or, with --tsc, the
+ * time stamp counter; latencies go to a log-linear histogram (16 buckets
+ * per power of two) from which p50, p99 and p99.9 are reported.
+ *
+ * Built as bench-stats, with ATOMIC_QUEUE_STATS defined, it also prints
+ * the statistics snapshot of the atomic queue after its run.
+ *
+ * The work stealing thread pool, selected as thread_pool, runs two task
+ * scenarios with --consumers workers and as many tasks as the queues move
+ * messages: pool_inject, --producers threads outside the pool spawning
+ * --messages empty tasks each through the injection queue and joining
+ * them, and pool_fork, a binary tree of tasks spawning and joining their
+ * two children from inside the workers. Only throughput, in tasks per
+ * second, is reported for them.
+ *
+ * Queues are skipped in scenarios they do not support (e.g. more than one
+ * producer on a single producer queue) and when they cannot be created; a
+ * run whose producer cannot push at all (e.g. a fanin lane that cannot be
+ * attached) stops and is reported as failed. For the broadcast ring every
+ * consumer receives every message; throughput is always reported as
+ * messages pushed per second.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "atomic_queue.h"
+#include "ring_queue.h"
+#include "mpsc_queue.h"
+#include "mpmc_queue.h"
+#include "ws_deque.h"
+#include "broadcast_ring.h"
+#include "shm_queue.h"
+#include "fanin_queue.h"
+#include "thread_pool.h"
+#include "smr.h"
+#include "cache_line.h"
+
+#define CAPACITY     4096
+#define MAX_BATCH    256
+#define MAX_THREADS  256
+#define MAX_CPUS     1024
+#define SPIN_LIMIT   64
+#define HIST_SUB     16
+#define HIST_BUCKETS (HIST_SUB * 61)
+
+struct msg {
+
+        struct list_head node_;
+        uint64_t stamp_;
+        uint64_t seq_;
+};
+
+struct options {
+
+        char queues[256];
+        int producers;
+        int consumers;
+        long messages;
+        int size;
+        int batch;
+        const char *pin;
+        bool tsc;
+        bool csv;
+};
+
+struct bench;
+
+struct adapter {
+
+        const char *name_;
+        int max_producers_;
+        int max_consumers_;
+        bool broadcast_;
+        bool (*init_)(struct bench *);
+        void (*fini_)(struct bench *);
+        int (*push_)(struct bench *, int, struct msg **, int); /* -1: cannot push at all */
+        int (*pop_)(struct bench *, int, uint64_t *, int);
+};
+
+struct thread {
+
+        struct bench *bench_;
+        int id_;
+        int cpu_;
+        pthread_t tid_;
+        char *pool_;                    /* producer: preallocated messages */
+        char *scratch_;                 /* consumer: copy out buffer */
+        uint64_t hist_[HIST_BUCKETS];   /* consumer: latencies */
+} __cache_aligned;
+
+struct bench {
+
+        const struct options *opt_;
+        const struct adapter *adapter_;
+
+        atomic_queue_t atomic_;
+        ring_queue_t ring_;
+        mpsc_queue_t mpsc_;
+        mpmc_queue_t mpmc_;
+        ws_deque_t deque_;
+        ebr_t ebr_;
+        broadcast_ring_t broadcast_;
+        shm_queue_t shm_producer_;
+        shm_queue_t shm_consumer_;
+        char shm_name_[64];
+        fanin_queue_t fanin_;
+        int lanes_[MAX_THREADS];
+
+        long total_;
+        _Atomic bool failed_;
+        _Atomic long consumed_ __cache_aligned;
+        pthread_barrier_t start_;
+};
+
+static struct thread *threads;
+static double tsc_per_ns = 0.0;
+static bool use_tsc = false;
+
+/*
+ * Clock
+ */
+
+static inline uint64_t now(void) {
+
+        struct timespec ts;
+
+#if defined(__x86_64__) || defined(__i386__)
+        if (use_tsc)
+                return __builtin_ia32_rdtsc();
+#endif
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double wall(void) {
+
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void calibrate_tsc(void) {
+
+#if defined(__x86_64__) || defined(__i386__)
+        double t0, t1;
+        uint64_t c0, c1;
+
+        t0 = wall();
+        c0 = __builtin_ia32_rdtsc();
+        do
+                t1 = wall();
+        while (t1 - t0 < 0.05);
+        c1 = __builtin_ia32_rdtsc();
+
+        tsc_per_ns = (c1 - c0) / ((t1 - t0) * 1e9);
+        use_tsc = true;
+#else
+        fprintf(stderr, "--tsc not supported on this architecture, using clock_gettime\n");
+#endif
+}
+
+static void backoff(int *spins) {
+
+        if ((*spins)++ < SPIN_LIMIT)
+                cpu_relax();
+        else
+                sched_yield();
+}
+
+/*
+ * Latency histogram
+ */
+
+static int hist_index(uint64_t v) {
+
+        int shift;
+
+        if (v < HIST_SUB)
+                return (int)v;
+
+        /* v >> shift in [HIST_SUB, 2 * HIST_SUB) */
+        shift = 63 - __builtin_clzll(v) - 4;
+        return HIST_SUB + shift * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+static uint64_t hist_value(int idx) {
+
+        int shift;
+
+        if (idx < HIST_SUB)
+                return idx;
+
+        shift = (idx - HIST_SUB) / HIST_SUB;
+        return (uint64_t)(HIST_SUB + (idx - HIST_SUB) % HIST_SUB) << shift;
+}
+
+static double hist_percentile(const uint64_t *hist, double p) {
+
+        uint64_t total = 0, seen = 0;
+        int i;
+
+        for (i = 0; i < HIST_BUCKETS; i++)
+                total += hist[i];
+        if (total == 0)
+                return 0.0;
+
+        for (i = 0; i < HIST_BUCKETS; i++) {
+                seen += hist[i];
+                if (seen >= p * total)
+                        break;
+        }
+        return use_tsc ? hist_value(i) / tsc_per_ns : (double)hist_value(i);
+}
+
+/*
+ * Adapters
+ */
+
+static int msg_size(struct bench *b) {
+
+        return b->opt_->size;
+}
+
+static bool atomic_init_(struct bench *b) {
+
+        Atomic_queue_init(&b->atomic_);
+        return b->atomic_ != NULL;
+}
+
+static void atomic_fini_(struct bench *b) {
+
+#ifdef ATOMIC_QUEUE_STATS
+        struct queue_stats st;
+
+        Atomic_queue_stats(b->atomic_, &st);
+        fprintf(stderr, "atomic_queue stats: pushes %lu pops %lu allocs %lu wakes %lu high_water %lu "
+                "pop_empty %lu spins %lu yields %lu parks %lu latency avg %.0f max %lu ns\n",
+                st.pushes, st.pops, st.allocs, st.wakes, st.high_water, st.pop_empty,
+                st.spins, st.yields, st.parks,
+                st.latency_samples ? (double)st.latency_sum_ns / st.latency_samples : 0.0,
+                st.latency_max_ns);
+#endif
+        Atomic_queue_fini(&b->atomic_);
+}
+
+static int atomic_push(struct bench *b, int p, struct msg **m, int n) {
+
+        Atomic_queue_push_n(b->atomic_, (void **)m, n);
+        return n;
+}
+
+static int atomic_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        struct msg *m[MAX_BATCH];
+        int i, got = Atomic_queue_pop_n(b->atomic_, (void **)m, n);
+
+        for (i = 0; i < got; i++)
+                stamps[i] = m[i]->stamp_;
+        return got;
+}
+
+static bool ring_init(struct bench *b) {
+
+        Ring_queue_init(&b->ring_, CAPACITY);
+        return b->ring_ != NULL;
+}
+
+static void ring_fini(struct bench *b) { Ring_queue_fini(&b->ring_); }
+
+static int ring_push(struct bench *b, int p, struct msg **m, int n) {
+
+        return Ring_queue_push_n(b->ring_, (void **)m, n);
+}
+
+static int ring_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        struct msg *m[MAX_BATCH];
+        int i, got = Ring_queue_pop_n(b->ring_, (void **)m, n);
+
+        for (i = 0; i < got; i++)
+                stamps[i] = m[i]->stamp_;
+        return got;
+}
+
+static bool mpsc_init(struct bench *b) {
+
+        Mpsc_queue_init(&b->mpsc_);
+        return b->mpsc_ != NULL;
+}
+
+static void mpsc_fini(struct bench *b) { Mpsc_queue_fini(&b->mpsc_); }
+
+static int mpsc_push(struct bench *b, int p, struct msg **m, int n) {
+
+        int i;
+
+        for (i = 0; i < n; i++)
+                Mpsc_queue_push(b->mpsc_, &m[i]->node_);
+        return n;
+}
+
+static int mpsc_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        struct list_head *node;
+        int got;
+
+        for (got = 0; got < n; got++) {
+                node = Mpsc_queue_pop(b->mpsc_);
+                if (node == NULL)
+                        break;
+                stamps[got] = list_entry(node, struct msg, node_)->stamp_;
+        }
+        return got;
+}
+
+static bool mpmc_init(struct bench *b) {
+
+        Mpmc_queue_init(&b->mpmc_, CAPACITY);
+        return b->mpmc_ != NULL;
+}
+
+static void mpmc_fini(struct bench *b) { Mpmc_queue_fini(&b->mpmc_); }
+
+static int mpmc_push(struct bench *b, int p, struct msg **m, int n) {
+
+        return Mpmc_queue_try_push_n(b->mpmc_, (void **)m, n);
+}
+
+static int mpmc_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        struct msg *m[MAX_BATCH];
+        int i, got = Mpmc_queue_try_pop_n(b->mpmc_, (void **)m, n);
+
+        for (i = 0; i < got; i++)
+                stamps[i] = m[i]->stamp_;
+        return got;
+}
+
+static bool deque_init(struct bench *b) {
+
+        Ebr_init(&b->ebr_);
+        if (b->ebr_ == NULL)
+                return false;
+
+        Ws_deque_init(&b->deque_, CAPACITY, b->ebr_);
+        if (b->deque_ == NULL) {
+                Ebr_fini(&b->ebr_);
+                return false;
+        }
+        return true;
+}
+
+static void deque_fini(struct bench *b) {
+
+        Ws_deque_fini(&b->deque_);
+        Ebr_fini(&b->ebr_);
+}
+
+static int deque_push(struct bench *b, int p, struct msg **m, int n) {
+
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (!Ws_deque_push(b->deque_, m[i]))
+                        break;
+        return i;
+}
+
+/* consumers are thieves, taking the oldest message */
+static int deque_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        struct msg *m;
+        int got;
+
+        for (got = 0; got < n; got++) {
+                m = (struct msg *)Ws_deque_steal(b->deque_);
+                if (m == NULL)
+                        break;
+                stamps[got] = m->stamp_;
+        }
+        return got;
+}
+
+static bool broadcast_init(struct bench *b) {
+
+        Broadcast_ring_init(&b->broadcast_, CAPACITY, msg_size(b), b->opt_->consumers);
+        return b->broadcast_ != NULL;
+}
+
+static void broadcast_fini(struct bench *b) { Broadcast_ring_fini(&b->broadcast_); }
+
+static int broadcast_push(struct bench *b, int p, struct msg **m, int n) {
+
+        long seq = Broadcast_ring_claim(b->broadcast_, n);
+        int i;
+
+        for (i = 0; i < n; i++)
+                memcpy(Broadcast_ring_slot(b->broadcast_, seq + i), m[i], msg_size(b));
+        Broadcast_ring_publish(b->broadcast_, seq + n - 1);
+        return n;
+}
+
+static int broadcast_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        long next = Broadcast_ring_next(b->broadcast_, c);
+        long last = Broadcast_ring_available(b->broadcast_, c);
+        long seq;
+        struct msg *m;
+
+        if (last < next)
+                return 0;
+        if (last - next >= n)
+                last = next + n - 1;
+
+        for (seq = next; seq <= last; seq++) {
+                m = (struct msg *)Broadcast_ring_slot(b->broadcast_, seq);
+                stamps[seq - next] = m->stamp_;
+        }
+        Broadcast_ring_release(b->broadcast_, c, last);
+        return (int)(last - next + 1);
+}
+
+static void shm_fini(struct bench *b) {
+
+        Shm_queue_detach(&b->shm_producer_);
+        Shm_queue_detach(&b->shm_consumer_);
+        Shm_queue_unlink(b->shm_name_);
+}
+
+static bool shm_init(struct bench *b) {
+
+        snprintf(b->shm_name_, sizeof(b->shm_name_), "/queue-bench-%d", (int)getpid());
+        Shm_queue_unlink(b->shm_name_);
+        if (Shm_queue_create(b->shm_name_, (size_t)CAPACITY * (msg_size(b) + 8)) < 0)
+                return false;
+
+        Shm_queue_attach(&b->shm_producer_, b->shm_name_, SHM_QUEUE_PRODUCER);
+        Shm_queue_attach(&b->shm_consumer_, b->shm_name_, SHM_QUEUE_CONSUMER);
+        if ((b->shm_producer_ == NULL) || (b->shm_consumer_ == NULL)) {
+                shm_fini(b);
+                return false;
+        }
+        return true;
+}
+
+static int shm_push(struct bench *b, int p, struct msg **m, int n) {
+
+        int i;
+
+        for (i = 0; i < n; i++)
+                if (!Shm_queue_push(b->shm_producer_, m[i], msg_size(b)))
+                        break;
+        return i;
+}
+
+static bool fanin_init(struct bench *b) {
+
+        int i;
+
+        Fanin_queue_init(&b->fanin_, b->opt_->producers, CAPACITY);
+        for (i = 0; i < b->opt_->producers; i++)
+                b->lanes_[i] = -1;
+        return b->fanin_ != NULL;
+}
+
+static void fanin_fini(struct bench *b) { Fanin_queue_fini(&b->fanin_); }
+
+static int fanin_push(struct bench *b, int p, struct msg **m, int n) {
+
+        /* attach from the producer thread, so its lane is first touched there */
+        if (b->lanes_[p] < 0) {
+                b->lanes_[p] = Fanin_queue_attach(b->fanin_);
+                if (b->lanes_[p] < 0)
+                        return -1;
+        }
+
+        return Fanin_queue_push_n(b->fanin_, b->lanes_[p], (void **)m, n);
+}
+
+static int fanin_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        struct msg *m[MAX_BATCH];
+        int i, got = Fanin_queue_pop_n(b->fanin_, (void **)m, n);
+
+        for (i = 0; i < got; i++)
+                stamps[i] = m[i]->stamp_;
+        return got;
+}
+
+static int shm_pop(struct bench *b, int c, uint64_t *stamps, int n) {
+
+        char *scratch = threads[b->opt_->producers + c].scratch_;
+        size_t len;
+        long off;
+        int got;
+
+        for (got = 0; got < n; got++) {
+                off = Shm_queue_front(b->shm_consumer_, &len);
+                if (off < 0)
+                        break;
+                memcpy(scratch, Shm_queue_ptr(b->shm_consumer_, off), len);
+                Shm_queue_pop(b->shm_consumer_);
+                stamps[got] = ((struct msg *)scratch)->stamp_;
+        }
+        return got;
+}
+
+static const struct adapter adapters[] = {
+        { "atomic_queue",   1, 1,  false, atomic_init_,   atomic_fini_,   atomic_push,    atomic_pop },
+        { "ring_queue",     1, 1,  false, ring_init,      ring_fini,      ring_push,      ring_pop },
+        { "mpsc_queue",     -1, 1, false, mpsc_init,      mpsc_fini,      mpsc_push,      mpsc_pop },
+        { "mpmc_queue",     -1, -1, false, mpmc_init,     mpmc_fini,      mpmc_push,      mpmc_pop },
+        { "ws_deque",       1, -1, false, deque_init,     deque_fini,     deque_push,     deque_pop },
+        { "broadcast_ring", 1, -1, true,  broadcast_init, broadcast_fini, broadcast_push, broadcast_pop },
+        { "shm_queue",      1, 1,  false, shm_init,       shm_fini,       shm_push,       shm_pop },
+        { "fanin_queue",    -1, 1, false, fanin_init,     fanin_fini,     fanin_push,     fanin_pop },
+};
+
+#define NADAPTERS (int)(sizeof(adapters) / sizeof(adapters[0]))
+
+/*
+ * Thread pool
+ */
+
+struct injector {
+
+        long tasks_;
+        pthread_t tid_;
+        pthread_barrier_t *start_;
+};
+
+static thread_pool_t pool;
+
+static void empty_task(void *arg) {
+
+        (void)arg;
+}
+
+/* a binary tree of tasks, arg is the depth left below this one */
+static void fork_task(void *arg) {
+
+        long depth = (long)(intptr_t)arg;
+        thread_pool_group_t group = THREAD_POOL_GROUP_INIT;
+
+        if (depth == 0)
+                return;
+
+        Thread_pool_spawn(pool, &group, fork_task, (void *)(intptr_t)(depth - 1));
+        Thread_pool_spawn(pool, &group, fork_task, (void *)(intptr_t)(depth - 1));
+        Thread_pool_join(pool, &group);
+}
+
+static void *injector(void *ptr) {
+
+        struct injector *in = (struct injector *)ptr;
+        thread_pool_group_t group = THREAD_POOL_GROUP_INIT;
+        long i;
+
+        pthread_barrier_wait(in->start_);
+
+        for (i = 0; i < in->tasks_; i++)
+                Thread_pool_spawn(pool, &group, empty_task, NULL);
+        Thread_pool_join(pool, &group);
+
+        return NULL;
+}
+
+static void report_pool(const struct options *opt, const char *name, long tasks, double elapsed) {
+
+        if (opt->csv)
+                printf("%s,%d,%d,,,none,%.0f,,,\n",
+                       name, opt->producers, opt->consumers, tasks / elapsed);
+        else
+                printf("%-16s %3d %3d %6s %5s %-7s %10.3f %10s %10s %10s\n",
+                       name, opt->producers, opt->consumers, "-", "-", "none",
+                       tasks / elapsed / 1e6, "-", "-", "-");
+        fflush(stdout);
+}
+
+static void run_pool(const struct options *opt) {
+
+        struct injector *in;
+        pthread_barrier_t start;
+        thread_pool_group_t group = THREAD_POOL_GROUP_INIT;
+        long total = opt->producers * opt->messages, tasks;
+        double t0;
+        int depth, i;
+
+        Thread_pool_init(&pool, opt->consumers);
+        in = (struct injector *)calloc(opt->producers, sizeof(struct injector));
+        if ((pool == NULL) || (in == NULL)) {
+                fprintf(stderr, "thread_pool: skipped, cannot create the pool\n");
+                Thread_pool_fini(&pool);
+                free(in);
+                return;
+        }
+
+        /* injection from outside the pool */
+        pthread_barrier_init(&start, NULL, opt->producers + 1);
+        for (i = 0; i < opt->producers; i++) {
+                in[i].tasks_ = opt->messages;
+                in[i].start_ = &start;
+                pthread_create(&in[i].tid_, NULL, injector, &in[i]);
+        }
+        pthread_barrier_wait(&start);
+        t0 = wall();
+        for (i = 0; i < opt->producers; i++)
+                pthread_join(in[i].tid_, NULL);
+        report_pool(opt, "pool_inject", total, wall() - t0);
+        pthread_barrier_destroy(&start);
+
+        /* nested spawn and join, about as many tasks: 2^(depth+1) - 1 */
+        for (depth = 0; ((2L << (depth + 1)) - 1 <= total) && (depth < 40); depth++)
+                ;
+        tasks = (2L << depth) - 1;
+        t0 = wall();
+        Thread_pool_spawn(pool, &group, fork_task, (void *)(intptr_t)depth);
+        Thread_pool_join(pool, &group);
+        report_pool(opt, "pool_fork", tasks, wall() - t0);
+
+        Thread_pool_fini(&pool);
+        free(in);
+}
+
+/*
+ * Threads
+ */
+
+static void *producer(void *ptr) {
+
+        struct thread *t = (struct thread *)ptr;
+        struct bench *b = t->bench_;
+        const struct options *opt = b->opt_;
+        struct msg *batch[MAX_BATCH];
+        long i = 0;
+        int n, k, done, spins;
+        uint64_t stamp;
+
+        pthread_barrier_wait(&b->start_);
+
+        while (i < opt->messages) {
+                n = (opt->messages - i < opt->batch) ? (int)(opt->messages - i) : opt->batch;
+
+                stamp = now();
+                for (k = 0; k < n; k++) {
+                        batch[k] = (struct msg *)(t->pool_ + (i + k) * opt->size);
+                        batch[k]->stamp_ = stamp;
+                        batch[k]->seq_ = i + k;
+                }
+
+                /* push the whole batch, waiting while the queue is full */
+                for (done = 0, spins = 0; done < n; ) {
+                        k = b->adapter_->push_(b, t->id_, batch + done, n - done);
+                        if (k < 0) {
+                                /* cannot push at all: stop, and the other threads with it */
+                                atomic_store_explicit(&b->failed_, true, memory_order_relaxed);
+                                return NULL;
+                        }
+                        if (k == 0) {
+                                if (atomic_load_explicit(&b->failed_, memory_order_relaxed))
+                                        return NULL;
+                                backoff(&spins);
+                        }
+                        done += k;
+                }
+                i += n;
+        }
+
+        return NULL;
+}
+
+static void *consumer(void *ptr) {
+
+        struct thread *t = (struct thread *)ptr;
+        struct bench *b = t->bench_;
+        const struct options *opt = b->opt_;
+        int c = t->id_ - opt->producers;
+        uint64_t stamps[MAX_BATCH];
+        uint64_t end;
+        long mine = 0;
+        int n, k, spins = 0;
+
+        pthread_barrier_wait(&b->start_);
+
+        for (;;) {
+                /* broadcast: every consumer sees every message */
+                if (b->adapter_->broadcast_ ? (mine >= b->total_) :
+                    (atomic_load_explicit(&b->consumed_, memory_order_relaxed) >= b->total_))
+                        break;
+
+                n = b->adapter_->pop_(b, c, stamps, opt->batch);
+                if (n == 0) {
+                        if (atomic_load_explicit(&b->failed_, memory_order_relaxed))
+                                break;
+                        backoff(&spins);
+                        continue;
+                }
+                spins = 0;
+
+                end = now();
+                for (k = 0; k < n; k++)
+                        t->hist_[hist_index(end - stamps[k])]++;
+
+                mine += n;
+                if (!b->adapter_->broadcast_)
+                        atomic_fetch_add_explicit(&b->consumed_, n, memory_order_relaxed);
+        }
+
+        return NULL;
+}
+
+/*
+ * Pinning
+ */
+
+struct cpu {
+
+        int id_;
+        int core_;
+        int package_;
+};
+
+static int read_int(const char *fmt, int cpu) {
+
+        char path[128];
+        FILE *f;
+        int v = -1;
+
+        snprintf(path, sizeof(path), fmt, cpu);
+        f = fopen(path, "r");
+        if (f == NULL)
+                return -1;
+        if (fscanf(f, "%d", &v) != 1)
+                v = -1;
+        fclose(f);
+        return v;
+}
+
+/* allowed cpus with their core and package, from sysfs */
+static int read_topology(struct cpu *cpus) {
+
+        cpu_set_t set;
+        int i, n = 0;
+
+        if (sched_getaffinity(0, sizeof(set), &set))
+                return 0;
+
+        for (i = 0; (i < CPU_SETSIZE) && (n < MAX_CPUS); i++) {
+                if (!CPU_ISSET(i, &set))
+                        continue;
+                cpus[n].id_ = i;
+                cpus[n].core_ = read_int("/sys/devices/system/cpu/cpu%d/topology/core_id", i);
+                cpus[n].package_ = read_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+                n++;
+        }
+        return n;
+}
+
+/* first cpu of each distinct core of package, or of any package if -1 */
+static int list_cores(struct cpu *cpus, int n, int package, int *out) {
+
+        int i, j, count = 0;
+        bool seen;
+
+        for (i = 0; i < n; i++) {
+                if ((package >= 0) && (cpus[i].package_ != package))
+                        continue;
+                for (j = 0, seen = false; (j < i) && !seen; j++)
+                        seen = (cpus[j].core_ == cpus[i].core_) && (cpus[j].package_ == cpus[i].package_);
+                if (!seen)
+                        out[count++] = i;
+        }
+        return count;
+}
+
+/* fill in the cpu of every thread, false if the mode cannot be honoured */
+static bool plan_pinning(const char *mode, struct thread *t, int producers, int consumers) {
+
+        static struct cpu cpus[MAX_CPUS];
+        int cores[MAX_CPUS], second[MAX_CPUS];
+        int n, ncores, pairs = 0, i, j, other = -1;
+        int nthreads = producers + consumers;
+
+        for (i = 0; i < nthreads; i++)
+                t[i].cpu_ = -1;
+
+        if (!strcmp(mode, "none"))
+                return true;
+
+        n = read_topology(cpus);
+        if (n == 0)
+                return false;
+
+        if (!strcmp(mode, "same")) {
+                for (i = 0; i < nthreads; i++)
+                        t[i].cpu_ = cpus[0].id_;
+                return true;
+        }
+
+        if (!strcmp(mode, "smt")) {
+                /* cores with two allowed siblings */
+                ncores = list_cores(cpus, n, -1, cores);
+                for (i = 0; i < ncores; i++) {
+                        for (j = cores[i] + 1; j < n; j++) {
+                                if ((cpus[j].core_ == cpus[cores[i]].core_) &&
+                                    (cpus[j].package_ == cpus[cores[i]].package_)) {
+                                        cores[pairs] = cores[i];
+                                        second[pairs++] = j;
+                                        break;
+                                }
+                        }
+                }
+                if (pairs == 0)
+                        return false;
+                for (i = 0; i < producers; i++)
+                        t[i].cpu_ = cpus[cores[i % pairs]].id_;
+                for (i = 0; i < consumers; i++)
+                        t[producers + i].cpu_ = cpus[second[i % pairs]].id_;
+                return true;
+        }
+
+        if (!strcmp(mode, "core")) {
+                ncores = list_cores(cpus, n, cpus[0].package_, cores);
+                if (ncores < 2)
+                        return false;
+                for (i = 0; i < nthreads; i++)
+                        t[i].cpu_ = cpus[cores[i % ncores]].id_;
+                return true;
+        }
+
+        if (!strcmp(mode, "socket")) {
+                for (i = 0; (i < n) && (other < 0); i++)
+                        if (cpus[i].package_ != cpus[0].package_)
+                                other = cpus[i].package_;
+                if (other < 0)
+                        return false;
+                ncores = list_cores(cpus, n, cpus[0].package_, cores);
+                for (i = 0; i < producers; i++)
+                        t[i].cpu_ = cpus[cores[i % ncores]].id_;
+                ncores = list_cores(cpus, n, other, cores);
+                for (i = 0; i < consumers; i++)
+                        t[producers + i].cpu_ = cpus[cores[i % ncores]].id_;
+                return true;
+        }
+
+        return false;
+}
+
+/*
+ * Driver
+ */
+
+/* merge the consumer histograms and print one result line */
+static void report(const struct options *opt, const struct adapter *a, bool pinned,
+                   long total, double elapsed) {
+
+        uint64_t hist[HIST_BUCKETS];
+        int nthreads = opt->producers + opt->consumers;
+        int i, j;
+
+        memset(hist, 0, sizeof(hist));
+        for (i = opt->producers; i < nthreads; i++)
+                for (j = 0; j < HIST_BUCKETS; j++)
+                        hist[j] += threads[i].hist_[j];
+
+        if (opt->csv)
+                printf("%s,%d,%d,%d,%d,%s,%.0f,%.0f,%.0f,%.0f\n",
+                       a->name_, opt->producers, opt->consumers, opt->size, opt->batch,
+                       pinned ? opt->pin : "none", total / elapsed,
+                       hist_percentile(hist, 0.50), hist_percentile(hist, 0.99),
+                       hist_percentile(hist, 0.999));
+        else
+                printf("%-16s %3d %3d %6d %5d %-7s %10.3f %10.0f %10.0f %10.0f\n",
+                       a->name_, opt->producers, opt->consumers, opt->size, opt->batch,
+                       pinned ? opt->pin : "none", total / elapsed / 1e6,
+                       hist_percentile(hist, 0.50), hist_percentile(hist, 0.99),
+                       hist_percentile(hist, 0.999));
+        fflush(stdout);
+}
+
+static void run(const struct options *opt, const struct adapter *a, bool pinned) {
+
+        struct bench b;
+        pthread_attr_t attr;
+        cpu_set_t set;
+        int nthreads = opt->producers + opt->consumers;
+        double start, elapsed;
+        int i;
+
+        memset(&b, 0, sizeof(b));
+        b.opt_ = opt;
+        b.adapter_ = a;
+        b.total_ = opt->producers * opt->messages;
+        atomic_init(&b.consumed_, 0);
+        atomic_init(&b.failed_, false);
+
+        if (!a->init_(&b)) {
+                fprintf(stderr, "%s: skipped, cannot create the queue\n", a->name_);
+                return;
+        }
+        pthread_barrier_init(&b.start_, NULL, nthreads + 1);
+
+        for (i = 0; i < nthreads; i++) {
+                threads[i].bench_ = &b;
+                threads[i].id_ = i;
+                memset(threads[i].hist_, 0, sizeof(threads[i].hist_));
+                threads[i].pool_ = NULL;
+                threads[i].scratch_ = NULL;
+                if (i < opt->producers)
+                        threads[i].pool_ = (char *)calloc(opt->messages, opt->size);
+                else
+                        threads[i].scratch_ = (char *)malloc(opt->size);
+
+                pthread_attr_init(&attr);
+                if (threads[i].cpu_ >= 0) {
+                        CPU_ZERO(&set);
+                        CPU_SET(threads[i].cpu_, &set);
+                        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+                }
+                pthread_create(&threads[i].tid_, &attr,
+                               (i < opt->producers) ? producer : consumer, &threads[i]);
+                pthread_attr_destroy(&attr);
+        }
+
+        pthread_barrier_wait(&b.start_);
+        start = wall();
+        for (i = 0; i < nthreads; i++)
+                pthread_join(threads[i].tid_, NULL);
+        elapsed = wall() - start;
+
+        if (atomic_load(&b.failed_))
+                fprintf(stderr, "%s: failed, a producer could not push\n", a->name_);
+        else
+                report(opt, a, pinned, b.total_, elapsed);
+
+        for (i = 0; i < nthreads; i++) {
+                free(threads[i].pool_);
+                free(threads[i].scratch_);
+        }
+        a->fini_(&b);
+        pthread_barrier_destroy(&b.start_);
+}
+
+static bool selected(const struct options *opt, const char *name) {
+
+        char list[sizeof(opt->queues)];
+        char *tok, *save;
+
+        if (!strcmp(opt->queues, "all"))
+                return true;
+
+        strcpy(list, opt->queues);
+        for (tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+                if (!strcmp(tok, name))
+                        return true;
+        return false;
+}
+
+static void usage(const char *prog) {
+
+        fprintf(stderr,
+                "usage: %s [options]\n"
+                "  --queues q1,q2,...   queues to run (default all):\n"
+                "                       atomic_queue ring_queue mpsc_queue mpmc_queue\n"
+                "                       ws_deque broadcast_ring shm_queue fanin_queue\n"
+                "                       thread_pool\n"
+                "  --producers n        producer threads (default 1)\n"
+                "  --consumers n        consumer threads (default 1)\n"
+                "  --messages n         messages per producer (default 1000000)\n"
+                "  --size n             message size in bytes (default 64, min %d)\n"
+                "  --batch n            messages per push/pop (default 1, max %d)\n"
+                "  --pin mode           none, same, smt, core or socket (default none)\n"
+                "  --tsc                time with the time stamp counter\n"
+                "  --csv                comma separated output\n",
+                prog, (int)sizeof(struct msg), MAX_BATCH);
+}
+
+int main(int argc, char *argv[]) {
+
+        struct options opt = { "all", 1, 1, 1000000, 64, 1, "none", false, false };
+        bool pinned;
+        int i;
+
+        for (i = 1; i < argc; i++) {
+                const char *arg = argv[i];
+                bool more = (i + 1 < argc);
+
+                if (!strcmp(arg, "--queues") && more)
+                        snprintf(opt.queues, sizeof(opt.queues), "%s", argv[++i]);
+                else if (!strcmp(arg, "--producers") && more)
+                        opt.producers = atoi(argv[++i]);
+                else if (!strcmp(arg, "--consumers") && more)
+                        opt.consumers = atoi(argv[++i]);
+                else if (!strcmp(arg, "--messages") && more)
+                        opt.messages = atol(argv[++i]);
+                else if (!strcmp(arg, "--size") && more)
+                        opt.size = atoi(argv[++i]);
+                else if (!strcmp(arg, "--batch") && more)
+                        opt.batch = atoi(argv[++i]);
+                else if (!strcmp(arg, "--pin") && more)
+                        opt.pin = argv[++i];
+                else if (!strcmp(arg, "--tsc"))
+                        opt.tsc = true;
+                else if (!strcmp(arg, "--csv"))
+                        opt.csv = true;
+                else {
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+
+        /* keep messages aligned for the header */
+        opt.size = (opt.size + 7) & ~7;
+        if ((opt.producers < 1) || (opt.consumers < 1) ||
+            (opt.producers + opt.consumers > MAX_THREADS) || (opt.messages < 1) ||
+            (opt.size < (int)sizeof(struct msg)) || (opt.batch < 1) || (opt.batch > MAX_BATCH)) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        if (opt.tsc)
+                calibrate_tsc();
+
+        if (posix_memalign((void **)&threads, CACHE_LINE_SIZE, MAX_THREADS * sizeof(struct thread)))
+                return 1;
+
+        pinned = plan_pinning(opt.pin, threads, opt.producers, opt.consumers);
+        if (!pinned) {
+                fprintf(stderr, "pinning '%s' not available on this machine, running unpinned\n", opt.pin);
+                plan_pinning("none", threads, opt.producers, opt.consumers);
+        }
+
+        if (opt.csv)
+                printf("queue,producers,consumers,size,batch,pin,msgs_per_sec,p50_ns,p99_ns,p999_ns\n");
+        else
+                printf("%-16s %3s %3s %6s %5s %-7s %10s %10s %10s %10s\n",
+                       "queue", "P", "C", "size", "batch", "pin", "Mmsg/s",
+                       "p50(ns)", "p99(ns)", "p99.9(ns)");
+
+        for (i = 0; i < NADAPTERS; i++) {
+                if (!selected(&opt, adapters[i].name_))
+                        continue;
+                if (((adapters[i].max_producers_ > 0) && (opt.producers > adapters[i].max_producers_)) ||
+                    ((adapters[i].max_consumers_ > 0) && (opt.consumers > adapters[i].max_consumers_))) {
+                        fprintf(stderr, "%s: skipped, %d producer(s) and %d consumer(s) not supported\n",
+                                adapters[i].name_, opt.producers, opt.consumers);
+                        continue;
+                }
+                run(&opt, &adapters[i], pinned);
+        }
+
+        if (selected(&opt, "thread_pool"))
+                run_pool(&opt);
+
+        free(threads);
+        return 0;
+}
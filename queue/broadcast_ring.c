@@ -0,0 +1,231 @@
+#include <sched.h>
+#include <stdatomic.h>
+#include "broadcast_ring.h"
+#include "cache_line.h"
+
+/*
+ * Broadcast ring implementation - one producer, many consumers, every
+ * consumer sees every event
+ *
+ * Disruptor style ring of capacity fixed size slots (capacity rounded up to
+ * a power of two) addressed by a 64 bit sequence number, slot seq being
+ * seq & mask_. The producer writes events in place:
+ *
+ *   seq = Broadcast_ring_claim(r, 1);           waits for a free slot, -1 for
+ *                                               n < 1 or n > capacity
+ *   fill Broadcast_ring_slot(r, seq);           zero copy
+ *   Broadcast_ring_publish(r, seq);             release store of published_
+ *
+ * and every consumer keeps its own cursor, the last sequence it is done
+ * with, so each event is written once whatever the number of readers:
+ *
+ *   next = Broadcast_ring_next(r, c);
+ *   last = Broadcast_ring_wait(r, c, next);     everything up to last is readable
+ *   read slots next .. last
+ *   Broadcast_ring_release(r, c, last);         release store of the cursor
+ *
+ * A consumer gated on another one with Broadcast_ring_gate(r, c, upstream)
+ * only sees events upstream has released, which builds pipelines such as
+ * journal -> replicate -> apply. The producer does not overwrite a slot
+ * until every consumer has released it.
+ *
+ * published_, every consumer cursor and the producer private state are on
+ * different cache lines; the producer keeps the minimum consumer cursor
+ * cached and only scans the cursors again when a claim would wrap past it.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define SPIN_LIMIT 64
+
+struct cursor {
+
+        _Atomic long seq_;
+        int upstream_;
+} __cache_aligned;
+
+struct broadcast_ring {
+
+        /* published by the producer */
+        _Atomic long published_ __cache_aligned;
+
+        /* producer private */
+        long claimed_ __cache_aligned;
+        long gate_cache_;
+
+        /* read only after init */
+        long mask_ __cache_aligned;
+        long slot_size_;
+        int consumers_;
+        char *slots_;
+        struct cursor *cursors_;
+};
+
+static void backoff(int *spins) {
+
+        if ((*spins)++ < SPIN_LIMIT)
+                cpu_relax();
+        else
+                sched_yield();
+}
+
+/* lowest sequence released by all the consumers */
+static long min_cursor(broadcast_ring_t r) {
+
+        long min = atomic_load_explicit(&r->published_, memory_order_relaxed);
+        long seq;
+        int i;
+
+        for (i = 0; i < r->consumers_; i++) {
+                seq = atomic_load_explicit(&r->cursors_[i].seq_, memory_order_acquire);
+                if (seq < min)
+                        min = seq;
+        }
+        return min;
+}
+
+void Broadcast_ring_init(broadcast_ring_t *r, int capacity, int slot_size, int consumers) {
+
+        long size = 1;
+        void *ptr;
+        int i;
+
+        while (size < capacity)
+                size <<= 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct broadcast_ring))) {
+                *r = NULL;
+                return;
+        }
+        *r = (struct broadcast_ring *)ptr;
+
+        /* keep slots pointer aligned */
+        (*r)->slot_size_ = (slot_size + sizeof(void *) - 1) & ~(long)(sizeof(void *) - 1);
+        (*r)->mask_ = size - 1;
+        (*r)->consumers_ = consumers;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, size * (*r)->slot_size_)) {
+                free(*r);
+                *r = NULL;
+                return;
+        }
+        (*r)->slots_ = (char *)ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, consumers * sizeof(struct cursor))) {
+                free((*r)->slots_);
+                free(*r);
+                *r = NULL;
+                return;
+        }
+        (*r)->cursors_ = (struct cursor *)ptr;
+
+        for (i = 0; i < consumers; i++) {
+                atomic_init(&(*r)->cursors_[i].seq_, -1);
+                (*r)->cursors_[i].upstream_ = -1;
+        }
+
+        atomic_init(&(*r)->published_, -1);
+        (*r)->claimed_ = -1;
+        (*r)->gate_cache_ = -1;
+}
+
+void Broadcast_ring_fini(broadcast_ring_t *r) {
+
+        CHECK_PTR(*r);
+
+        free((*r)->cursors_);
+        free((*r)->slots_);
+        free(*r);
+        *r = NULL;
+}
+
+bool Broadcast_ring_gate(broadcast_ring_t r, int consumer, int upstream) {
+
+        if ((r == NULL) || (consumer < 0) || (consumer >= r->consumers_) ||
+            (upstream >= r->consumers_) || (upstream == consumer))
+                return false;
+
+        /* must be set up before events flow */
+        r->cursors_[consumer].upstream_ = upstream;
+        return true;
+}
+
+long Broadcast_ring_claim(broadcast_ring_t r, int n) {
+
+        long last, wrap;
+        int spins = 0;
+
+        /* a claim must fit in the ring, or it would wait forever */
+        if ((r == NULL) || (n < 1) || (n > r->mask_ + 1))
+                return -1;
+
+        last = r->claimed_ + n;
+        wrap = last - (r->mask_ + 1);
+
+        /* wait until every consumer released the slots to overwrite */
+        if (wrap > r->gate_cache_) {
+                for (;;) {
+                        r->gate_cache_ = min_cursor(r);
+                        if (wrap <= r->gate_cache_)
+                                break;
+                        backoff(&spins);
+                }
+        }
+
+        r->claimed_ = last;
+        return last - n + 1;
+}
+
+void *Broadcast_ring_slot(broadcast_ring_t r, long seq) {
+
+        return r->slots_ + (seq & r->mask_) * r->slot_size_;
+}
+
+void Broadcast_ring_publish(broadcast_ring_t r, long seq) {
+
+        CHECK_PTR(r);
+
+        /* everything up to seq becomes visible at once */
+        atomic_store_explicit(&r->published_, seq, memory_order_release);
+}
+
+long Broadcast_ring_next(broadcast_ring_t r, int consumer) {
+
+        return atomic_load_explicit(&r->cursors_[consumer].seq_, memory_order_relaxed) + 1;
+}
+
+long Broadcast_ring_available(broadcast_ring_t r, int consumer) {
+
+        long avail = atomic_load_explicit(&r->published_, memory_order_acquire);
+        long upstream;
+
+        if (r->cursors_[consumer].upstream_ >= 0) {
+                upstream = atomic_load_explicit(&r->cursors_[r->cursors_[consumer].upstream_].seq_,
+                                                memory_order_acquire);
+                if (upstream < avail)
+                        avail = upstream;
+        }
+        return avail;
+}
+
+long Broadcast_ring_wait(broadcast_ring_t r, int consumer, long seq) {
+
+        long avail;
+        int spins = 0;
+
+        while ((avail = Broadcast_ring_available(r, consumer)) < seq)
+                backoff(&spins);
+
+        return avail;
+}
+
+void Broadcast_ring_release(broadcast_ring_t r, int consumer, long seq) {
+
+        CHECK_PTR(r);
+
+        atomic_store_explicit(&r->cursors_[consumer].seq_, seq, memory_order_release);
+}
@@ -0,0 +1,19 @@
+#ifndef __BROADCAST_RING_H__
+#define __BROADCAST_RING_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct broadcast_ring *broadcast_ring_t;
+
+void Broadcast_ring_init(broadcast_ring_t *, int, int, int);
+void Broadcast_ring_fini(broadcast_ring_t *);
+bool Broadcast_ring_gate(broadcast_ring_t, int, int);
+long Broadcast_ring_claim(broadcast_ring_t, int);
+void *Broadcast_ring_slot(broadcast_ring_t, long);
+void Broadcast_ring_publish(broadcast_ring_t, long);
+long Broadcast_ring_next(broadcast_ring_t, int);
+long Broadcast_ring_available(broadcast_ring_t, int);
+long Broadcast_ring_wait(broadcast_ring_t, int, long);
+void Broadcast_ring_release(broadcast_ring_t, int, long);
+#endif
@@ -0,0 +1,20 @@
+#ifndef __CACHE_LINE_H__
+#define __CACHE_LINE_H__
+
+/*
+ * Cache line size used to keep data written by different threads
+ * on different lines and avoid false sharing
+ */
+#define CACHE_LINE_SIZE 64
+
+#define __cache_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
+/* hint the cpu that we are busy waiting on a cache line */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() do { } while (0)
+#endif
+#endif
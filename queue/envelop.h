@@ -1,10 +1,14 @@
 #ifndef __ENVELOP_H__
 #define __ENVELOP_H__
 
-#include "list.h"
+#include <stdatomic.h>
+#include <stdint.h>
 
 struct envelop {
         void *elem_;
-        struct list_head head_;
+        struct envelop *_Atomic next_;
+#ifdef ATOMIC_QUEUE_STATS
+        uint64_t stamp_; /* push time in ns of sampled envelops, 0 otherwise */
+#endif
 };
 #endif
@@ -0,0 +1,292 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include "fanin_queue.h"
+#include "ring_queue.h"
+#include "cache_line.h"
+
+/*
+ * Fan-in queue implementation - many producers, one consumer
+ *
+ * Instead of a single queue whose tail every producer contends on, each
+ * producer gets its own SPSC lane (ring_queue.c), so a push costs the same
+ * uncontended ring push whatever the number of producers:
+ *
+ *   producer 0 --> [ lane 0 ]--+
+ *   producer 1 --> [ lane 1 ]--+          summary_
+ *   producer 2 --> [ lane 2 ]--+--> consumer   0 1 1 0 ...
+ *      ...           ...       |    (one bit per lane, set when it may
+ *   producer n --> [ lane n ]--+     have elements)
+ *
+ * Fanin_queue_attach() hands a lane to the calling producer and allocates
+ * its ring from that thread, so with a first touch NUMA policy the slots
+ * live on the producer's node. Lanes are cache line aligned. A push on a
+ * lane out of range or not attached, such as the -1 of a failed attach,
+ * fails as if the lane was full.
+ *
+ * The consumer polls the lanes whose bit is set, round robin starting after
+ * the last lane it served, taking at most weight elements per lane and
+ * visit (weighted round robin, Fanin_queue_set_weight()). It clears the bit
+ * of a lane it finds empty and sets it back if the lane refilled meanwhile.
+ *
+ * After a push the producer sets its bit only if it reads it clear, so a
+ * busy lane costs no shared write. That check is a plain load, without the
+ * fence that would be needed to never miss a bit cleared concurrently by
+ * the consumer: instead, every SWEEP_INTERVAL polls, busy or not, the
+ * consumer sweeps every lane and sets the bits of the non-empty ones, which
+ * bounds how long a missed bit can hide a lane even while other lanes keep
+ * the consumer busy.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define DEFAULT_WEIGHT 16
+#define SWEEP_INTERVAL 64
+
+struct lane {
+
+        _Atomic(ring_queue_t) ring_;
+        int weight_;
+} __cache_aligned;
+
+struct fanin_queue {
+
+        /* consumer */
+        int next_ __cache_aligned;
+        int polls_;
+
+        /* producers, bits set on the empty -> non-empty transition */
+        _Atomic uint64_t *summary_;
+        _Atomic int attached_;
+
+        /* read only after init */
+        struct lane *lanes_;
+        int nlanes_;
+        int nwords_;
+        int capacity_;
+};
+
+static void set_bit(fanin_queue_t q, int lane) {
+
+        _Atomic uint64_t *word = &q->summary_[lane / 64];
+        uint64_t bit = 1ULL << (lane % 64);
+
+        if (!(atomic_load_explicit(word, memory_order_relaxed) & bit))
+                atomic_fetch_or_explicit(word, bit, memory_order_release);
+}
+
+/* set the bits of every lane with elements */
+static void sweep(fanin_queue_t q) {
+
+        ring_queue_t ring;
+        int i;
+
+        for (i = 0; i < q->nlanes_; i++) {
+                ring = atomic_load_explicit(&q->lanes_[i].ring_, memory_order_acquire);
+                if ((ring != NULL) && !Ring_queue_empty(ring))
+                        set_bit(q, i);
+        }
+}
+
+/* pop from one lane, clearing its bit if it runs dry */
+static int pop_lane(fanin_queue_t q, int lane, void **elems, int max) {
+
+        ring_queue_t ring = atomic_load_explicit(&q->lanes_[lane].ring_, memory_order_acquire);
+        int n = 0;
+
+        if (ring != NULL)
+                n = Ring_queue_pop_n(ring, elems, max);
+
+        if (n < max) {
+                atomic_fetch_and_explicit(&q->summary_[lane / 64], ~(1ULL << (lane % 64)),
+                                          memory_order_relaxed);
+                if ((ring != NULL) && !Ring_queue_empty(ring))
+                        set_bit(q, lane);
+        }
+        return n;
+}
+
+void Fanin_queue_init(fanin_queue_t *q, int lanes, int capacity) {
+
+        void *ptr;
+        int i;
+
+        if (lanes < 1)
+                lanes = 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct fanin_queue))) {
+                *q = NULL;
+                return;
+        }
+        *q = (struct fanin_queue *)ptr;
+
+        (*q)->nlanes_ = lanes;
+        (*q)->nwords_ = (lanes + 63) / 64;
+        (*q)->capacity_ = capacity;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, lanes * sizeof(struct lane))) {
+                free(*q);
+                *q = NULL;
+                return;
+        }
+        (*q)->lanes_ = (struct lane *)ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, (*q)->nwords_ * sizeof(uint64_t))) {
+                free((*q)->lanes_);
+                free(*q);
+                *q = NULL;
+                return;
+        }
+        (*q)->summary_ = (_Atomic uint64_t *)ptr;
+
+        for (i = 0; i < lanes; i++) {
+                atomic_init(&(*q)->lanes_[i].ring_, NULL);
+                (*q)->lanes_[i].weight_ = DEFAULT_WEIGHT;
+        }
+        for (i = 0; i < (*q)->nwords_; i++)
+                atomic_init(&(*q)->summary_[i], 0);
+
+        atomic_init(&(*q)->attached_, 0);
+        (*q)->next_ = 0;
+        (*q)->polls_ = 0;
+}
+
+void Fanin_queue_fini(fanin_queue_t *q) {
+
+        ring_queue_t ring;
+        int i;
+
+        CHECK_PTR(*q);
+
+        for (i = 0; i < (*q)->nlanes_; i++) {
+                ring = atomic_load_explicit(&(*q)->lanes_[i].ring_, memory_order_relaxed);
+                Ring_queue_fini(&ring);
+        }
+
+        free((void *)(*q)->summary_);
+        free((*q)->lanes_);
+        free(*q);
+        *q = NULL;
+}
+
+int Fanin_queue_attach(fanin_queue_t q) {
+
+        ring_queue_t ring;
+        int lane;
+
+        if (q == NULL)
+                return -1;
+
+        lane = atomic_fetch_add_explicit(&q->attached_, 1, memory_order_relaxed);
+        if (lane >= q->nlanes_)
+                return -1;
+
+        /* allocated by the producer thread, first touched on its node */
+        Ring_queue_init(&ring, q->capacity_);
+        if (ring == NULL)
+                return -1;
+
+        atomic_store_explicit(&q->lanes_[lane].ring_, ring, memory_order_release);
+        return lane;
+}
+
+void Fanin_queue_set_weight(fanin_queue_t q, int lane, int weight) {
+
+        CHECK_PTR(q);
+
+        /* consumer side setting, elements taken per visit */
+        if ((lane >= 0) && (lane < q->nlanes_))
+                q->lanes_[lane].weight_ = (weight > 0) ? weight : 1;
+}
+
+bool Fanin_queue_push(fanin_queue_t q, int lane, void *elem) {
+
+        ring_queue_t ring;
+
+        if ((q == NULL) || (lane < 0) || (lane >= q->nlanes_))
+                return false;
+
+        /* NULL until attached, refused by Ring_queue_push() */
+        ring = atomic_load_explicit(&q->lanes_[lane].ring_, memory_order_relaxed);
+        if (!Ring_queue_push(ring, elem))
+                return false;
+
+        set_bit(q, lane);
+        return true;
+}
+
+int Fanin_queue_push_n(fanin_queue_t q, int lane, void **elems, int n) {
+
+        ring_queue_t ring;
+
+        if ((q == NULL) || (lane < 0) || (lane >= q->nlanes_))
+                return 0;
+
+        ring = atomic_load_explicit(&q->lanes_[lane].ring_, memory_order_relaxed);
+        n = Ring_queue_push_n(ring, elems, n);
+        if (n > 0)
+                set_bit(q, lane);
+        return n;
+}
+
+int Fanin_queue_pop_n(fanin_queue_t q, void **elems, int max) {
+
+        int start, word, shift, lane, take, got = 0, k;
+        uint64_t bits;
+
+        if ((q == NULL) || (max <= 0))
+                return 0;
+
+        /* walk the set bits round robin from next_, wrapping once */
+        start = q->next_;
+        for (k = 0; (k <= q->nwords_) && (got < max); k++) {
+                word = (start / 64 + k) % q->nwords_;
+                bits = atomic_load_explicit(&q->summary_[word], memory_order_acquire);
+                shift = start % 64;
+                if (k == 0)
+                        bits &= ~0ULL << shift;
+                else if (k == q->nwords_)
+                        bits &= shift ? ~(~0ULL << shift) : 0;
+
+                while (bits && (got < max)) {
+                        lane = word * 64 + __builtin_ctzll(bits);
+                        bits &= bits - 1;
+
+                        take = q->lanes_[lane].weight_;
+                        if (take > max - got)
+                                take = max - got;
+                        got += pop_lane(q, lane, elems + got, take);
+                        q->next_ = (lane + 1) % q->nlanes_;
+                }
+        }
+
+        /* recover lanes whose bit was lost, whether this poll found data or not */
+        if (++q->polls_ >= SWEEP_INTERVAL) {
+                q->polls_ = 0;
+                sweep(q);
+        }
+        return got;
+}
+
+void *Fanin_queue_pop(fanin_queue_t q) {
+
+        void *elem;
+
+        return (Fanin_queue_pop_n(q, &elem, 1) == 1) ? elem : NULL;
+}
+
+bool Fanin_queue_empty(fanin_queue_t q) {
+
+        ring_queue_t ring;
+        int i;
+
+        for (i = 0; i < q->nlanes_; i++) {
+                ring = atomic_load_explicit(&q->lanes_[i].ring_, memory_order_acquire);
+                if ((ring != NULL) && !Ring_queue_empty(ring))
+                        return false;
+        }
+        return true;
+}
@@ -0,0 +1,18 @@
+#ifndef __FANIN_QUEUE_H__
+#define __FANIN_QUEUE_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct fanin_queue *fanin_queue_t;
+
+void Fanin_queue_init(fanin_queue_t *, int, int);
+void Fanin_queue_fini(fanin_queue_t *);
+int  Fanin_queue_attach(fanin_queue_t);
+void Fanin_queue_set_weight(fanin_queue_t, int, int);
+bool Fanin_queue_push(fanin_queue_t, int, void *);
+int  Fanin_queue_push_n(fanin_queue_t, int, void **, int);
+void *Fanin_queue_pop(fanin_queue_t);
+int  Fanin_queue_pop_n(fanin_queue_t, void **, int);
+bool Fanin_queue_empty(fanin_queue_t);
+#endif
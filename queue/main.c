@@ -9,24 +9,20 @@ void *thread(void *ptr) {
         int *e;
 
         for(;;) {
-                while (Atomic_queue_empty(q));
-
-                /* get front element */
-                e = (int *)Atomic_queue_front(q);
+                /* wait for and pop front element */
+                e = (int *)Atomic_queue_pop_wait(q, -1);
 
                 /* print element */
                 fprintf(stdout, "received: %d\n", *e);
 
                 /* check term command */
                 if (*e == -1) {
-                        free(e);
+                        Atomic_queue_free(q, e);
                         break;
                 }
 
-                /* pop element */
-                Atomic_queue_pop(q);
-
-                free(e);
+                /* back to the producer slab */
+                Atomic_queue_free(q, e);
         }
 
         pthread_exit(NULL);
@@ -38,10 +34,28 @@ int main(int argc, char *argv[]) {
         pthread_t tid;
         pthread_attr_t attr;
         atomic_queue_t q;
-        int *e;
+        slab_t slab;
+        int *e, *end;
 
-        /* init queue */
+        /* init queue, elements come from a slab owned by this thread */
         Atomic_queue_init(&q);
+        Slab_init(&slab, sizeof(int));
+        if ((q == NULL) || (slab == NULL)) {
+                fprintf(stderr, "cannot create the queue or its slab\n");
+                Atomic_queue_fini(&q);
+                Slab_fini(&slab);
+                return 1;
+        }
+        Atomic_queue_attach_slab(q, slab);
+
+        /* the end request, allocated first so the thread can always be stopped */
+        end = (int *)Atomic_queue_alloc(q);
+        if (end == NULL) {
+                fprintf(stderr, "cannot allocate an element\n");
+                Atomic_queue_fini(&q);
+                Slab_fini(&slab);
+                return 1;
+        }
 
         /* start thread */
         pthread_attr_init(&attr);
@@ -51,20 +65,24 @@ int main(int argc, char *argv[]) {
 
         /* push new elements in the queue */
         for (i = 0; i < 15; i++) {
-                e = (int *)malloc(sizeof(int));
+                e = (int *)Atomic_queue_alloc(q);
+                if (e == NULL) {
+                        fprintf(stderr, "cannot allocate an element\n");
+                        break;
+                }
                 *e = i;
                 Atomic_queue_push(q, e);
         }
 
         /* submit end request : integet = -1 */
-        e = (int *)malloc(sizeof(int));
-        *e = -1;
-        Atomic_queue_push(q, e);
+        *end = -1;
+        Atomic_queue_push(q, end);
 
         pthread_join(tid, NULL);
 
-        /* fini queue */
+        /* fini queue, then the slab */
         Atomic_queue_fini(&q);
+        Slab_fini(&slab);
 
-        return 0;
+        return (i == 15) ? 0 : 1;
 }
@@ -0,0 +1,64 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "atomic_queue_coro.hpp"
+
+/*
+ * AwaitableQueue example: a consumer coroutine on an Executor pops what a
+ * producer thread pushes. The producer waits for each element to be
+ * consumed and then pauses before the next one, so the consumer always
+ * finds the queue empty, suspends, and is resumed through the eventfd.
+ */
+
+#define MESSAGES 20
+
+static int values[MESSAGES];
+static std::atomic<int> consumed(0);
+static int waits = 0, errors = 0;
+
+static queues::Task consumer(queues::AwaitableQueue &q, queues::Executor &executor) {
+
+        int i, *e;
+
+        for (i = 0; i < MESSAGES; i++) {
+                /* empty: this co_await suspends until the producer pushes */
+                if (Atomic_queue_empty(q.get()))
+                        waits++;
+
+                e = (int *)co_await q.pop();
+                if ((e == NULL) || (*e != i))
+                        errors++;
+                consumed.store(i + 1, std::memory_order_release);
+        }
+
+        executor.stop();
+}
+
+int main(int argc, char *argv[]) {
+
+        queues::Executor executor;
+        queues::AwaitableQueue q(executor);
+        int i;
+
+        for (i = 0; i < MESSAGES; i++)
+                values[i] = i;
+
+        /* push one element at a time, after the consumer went back to sleep */
+        std::thread producer([&q]() {
+                for (int j = 0; j < MESSAGES; j++) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        q.push(&values[j]);
+                        while (consumed.load(std::memory_order_acquire) <= j)
+                                std::this_thread::yield();
+                }
+        });
+
+        consumer(q, executor);
+        executor.run();
+        producer.join();
+
+        fprintf(stdout, "received: %d, suspended: %d, errors: %d\n", consumed.load(), waits, errors);
+
+        return ((errors == 0) && (waits > 0) && (consumed.load() == MESSAGES)) ? 0 : 1;
+}
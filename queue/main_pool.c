@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "thread_pool.h"
+
+/*
+ * Thread pool example: fib(n) computed by tasks that spawn their two
+ * halves and join them from inside the workers, while outside threads
+ * inject flat batches of tasks into the same pool and join them too.
+ */
+
+#define WORKERS   4
+#define FIB       22
+#define INJECTORS 3
+#define TASKS     20000
+
+struct fib {
+
+        int n_;
+        long result_;
+};
+
+static thread_pool_t pool;
+static _Atomic long executed = 0;
+
+static long fib_seq(int n) {
+
+        return (n < 2) ? n : fib_seq(n - 1) + fib_seq(n - 2);
+}
+
+/* nested spawn and join on the worker deques */
+static void fib_task(void *arg) {
+
+        struct fib *f = (struct fib *)arg;
+        struct fib a, b;
+        thread_pool_group_t group = THREAD_POOL_GROUP_INIT;
+
+        if (f->n_ < 2) {
+                f->result_ = f->n_;
+                return;
+        }
+
+        a.n_ = f->n_ - 1;
+        b.n_ = f->n_ - 2;
+        Thread_pool_spawn(pool, &group, fib_task, &a);
+        Thread_pool_spawn(pool, &group, fib_task, &b);
+        Thread_pool_join(pool, &group);
+
+        f->result_ = a.result_ + b.result_;
+}
+
+static void count_task(void *arg) {
+
+        atomic_fetch_add_explicit(&executed, 1, memory_order_relaxed);
+}
+
+/* a thread outside the pool: its tasks go through the injection queue */
+void *injector(void *ptr) {
+
+        thread_pool_group_t group = THREAD_POOL_GROUP_INIT;
+        struct fib *f = (struct fib *)ptr;
+        int i;
+
+        Thread_pool_spawn(pool, &group, fib_task, f);
+        for (i = 0; i < TASKS; i++)
+                Thread_pool_spawn(pool, &group, count_task, NULL);
+        Thread_pool_join(pool, &group);
+
+        pthread_exit(NULL);
+}
+
+int main(int argc, char *argv[]) {
+
+        pthread_t tid[INJECTORS];
+        struct fib root, fibs[INJECTORS];
+        thread_pool_group_t group = THREAD_POOL_GROUP_INIT;
+        int i, errors = 0;
+
+        Thread_pool_init(&pool, WORKERS);
+        if (pool == NULL) {
+                fprintf(stderr, "cannot create the thread pool\n");
+                return 1;
+        }
+
+        for (i = 0; i < INJECTORS; i++) {
+                fibs[i].n_ = FIB - 4 + i;
+                pthread_create(&tid[i], NULL, injector, &fibs[i]);
+        }
+
+        /* the main thread is outside the pool as well */
+        root.n_ = FIB;
+        Thread_pool_spawn(pool, &group, fib_task, &root);
+        Thread_pool_join(pool, &group);
+
+        for (i = 0; i < INJECTORS; i++) {
+                pthread_join(tid[i], NULL);
+                if (fibs[i].result_ != fib_seq(fibs[i].n_))
+                        errors++;
+        }
+        if (root.result_ != fib_seq(root.n_))
+                errors++;
+        if (atomic_load(&executed) != (long)INJECTORS * TASKS)
+                errors++;
+
+        Thread_pool_fini(&pool);
+
+        fprintf(stdout, "fib(%d): %ld, injected: %ld, errors: %d\n",
+                root.n_, root.result_, atomic_load(&executed), errors);
+
+        return (errors == 0) ? 0 : 1;
+}
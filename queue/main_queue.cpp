@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "atomic_queue.hpp"
+
+/*
+ * AtomicQueue example: a producer thread moves strings through a queue
+ * with small blocks, so elements cross many block boundaries and blocks
+ * get recycled; Tracked counts live elements to check that every one
+ * constructed in the queue is destroyed exactly once.
+ */
+
+#define MESSAGES 100000
+
+static int live = 0;
+
+struct Tracked {
+
+        std::string text_;
+        long seq_;
+
+        Tracked(long seq) : text_("message " + std::to_string(seq)), seq_(seq) {
+                __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+        }
+
+        Tracked(Tracked &&other) : text_(std::move(other.text_)), seq_(other.seq_) {
+                __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+        }
+
+        Tracked &operator=(Tracked &&other) {
+                text_ = std::move(other.text_);
+                seq_ = other.seq_;
+                return *this;
+        }
+
+        ~Tracked() {
+                __atomic_sub_fetch(&live, 1, __ATOMIC_RELAXED);
+        }
+};
+
+int main(int argc, char *argv[]) {
+
+        long i, errors = 0;
+
+        {
+                queues::AtomicQueue<Tracked, 8> q;
+                Tracked e(-1);
+
+                /* push new elements in the queue, built in place */
+                std::thread producer([&q]() {
+                        for (long j = 0; j < MESSAGES; j++)
+                                q.emplace(j);
+                });
+
+                /* pop them in order */
+                for (i = 0; i < MESSAGES; i++) {
+                        while (!q.tryPop(e))
+                                std::this_thread::yield();
+                        if ((e.seq_ != i) || (e.text_ != "message " + std::to_string(i)))
+                                errors++;
+                }
+                producer.join();
+
+                /* leave some in the queue for the destructor */
+                for (i = 0; i < 3 * 8 + 1; i++)
+                        q.emplace(i);
+        }
+
+        fprintf(stdout, "received: %d, errors: %ld, live: %d\n", MESSAGES, errors, live);
+
+        return ((errors == 0) && (live == 0)) ? 0 : 1;
+}
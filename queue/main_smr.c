@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "smr.h"
+
+/*
+ * Hazard pointers example: a Treiber stack hammered by threads that push
+ * and pop their own nodes. Popped nodes are retired, not freed, so a
+ * thread still reading one it protected never sees it freed or reused,
+ * which also rules out ABA on the compare and swap of top. Every node
+ * carries a magic value cleared when it is really freed, and all nodes
+ * must have been freed once the domain is finalised.
+ */
+
+#define THREADS     4
+#define OPS         100000
+#define DEPTH       8
+#define YIELD_EVERY 16
+#define MAGIC       0x5AFE5AFEL
+
+struct node {
+
+        long magic_;
+        long value_;
+        struct node *next_;
+};
+
+static hp_t hp;
+static void *_Atomic top = NULL;
+static _Atomic long allocated = 0, freed = 0, popped = 0, errors = 0;
+static _Thread_local long pops = 0;
+
+static void free_node(void *ptr) {
+
+        struct node *n = (struct node *)ptr;
+
+        n->magic_ = 0;
+        atomic_fetch_add_explicit(&freed, 1, memory_order_relaxed);
+        free(n);
+}
+
+static void push(long value) {
+
+        struct node *n = (struct node *)malloc(sizeof(struct node));
+        void *old;
+
+        n->magic_ = MAGIC;
+        n->value_ = value;
+        atomic_fetch_add_explicit(&allocated, 1, memory_order_relaxed);
+
+        old = atomic_load_explicit(&top, memory_order_relaxed);
+        do {
+                n->next_ = (struct node *)old;
+        } while (!atomic_compare_exchange_weak_explicit(&top, &old, n,
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+}
+
+/* the value of the top node, -1 if the stack is empty */
+static long pop(void) {
+
+        struct node *n;
+        void *expected;
+        long value;
+
+        for (;;) {
+                /* n cannot be freed while protected */
+                n = (struct node *)Hp_protect(hp, 0, &top);
+                if (n == NULL) {
+                        Hp_clear(hp, 0);
+                        return -1;
+                }
+
+                /* now and then let others pop n meanwhile, even on one cpu */
+                if ((++pops % YIELD_EVERY) == 0)
+                        sched_yield();
+                if (n->magic_ != MAGIC)
+                        atomic_fetch_add(&errors, 1);
+
+                expected = n;
+                if (atomic_compare_exchange_strong(&top, &expected, n->next_))
+                        break;
+        }
+        Hp_clear(hp, 0);
+
+        /* only the thread that unlinked n may read its value */
+        value = n->value_;
+        Hp_retire(hp, n, free_node);
+        atomic_fetch_add_explicit(&popped, 1, memory_order_relaxed);
+        return value;
+}
+
+void *thread(void *ptr) {
+
+        long id = (long)ptr;
+        long i, j;
+
+        for (i = 0; i < OPS; i += DEPTH) {
+                for (j = 0; j < DEPTH; j++)
+                        push(id * OPS + i + j);
+                for (j = 0; j < DEPTH; j++)
+                        if (pop() < 0)
+                                atomic_fetch_add(&errors, 1);
+        }
+
+        pthread_exit(NULL);
+}
+
+int main(int argc, char *argv[]) {
+
+        pthread_t tid[THREADS];
+        long i;
+
+        Hp_init(&hp, 1);
+        if (hp == NULL) {
+                fprintf(stderr, "cannot create the hazard pointers domain\n");
+                return 1;
+        }
+
+        for (i = 0; i < THREADS; i++)
+                pthread_create(&tid[i], NULL, thread, (void *)i);
+        for (i = 0; i < THREADS; i++)
+                pthread_join(tid[i], NULL);
+
+        /* every push was matched by a pop */
+        if (pop() >= 0)
+                atomic_fetch_add(&errors, 1);
+
+        /* frees what is still retired */
+        Hp_fini(&hp);
+
+        fprintf(stdout, "popped: %ld, freed: %ld of %ld, errors: %ld\n",
+                atomic_load(&popped), atomic_load(&freed), atomic_load(&allocated),
+                atomic_load(&errors));
+
+        return ((atomic_load(&errors) == 0) && (atomic_load(&freed) == atomic_load(&allocated)) &&
+                (atomic_load(&popped) == (long)THREADS * OPS)) ? 0 : 1;
+}
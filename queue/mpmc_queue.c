@@ -0,0 +1,249 @@
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "mpmc_queue.h"
+#include "cache_line.h"
+
+/*
+ * Bounded queue implementation - valid for many producers and many consumers
+ *
+ * Vyukov's bounded MPMC queue. The queue is an array of capacity cells,
+ * capacity rounded up to a power of two, each cell padded to a cache line
+ * and holding a sequence number next to the user pointer. Producers claim
+ * positions by advancing tail_, consumers by advancing head_, both with a
+ * compare and swap; the cell sequence number tells whether the cell at a
+ * position is ready for that position:
+ *
+ *   seq_ == pos                      free, a producer may claim pos
+ *   seq_ == pos + 1                  full, a consumer may claim pos
+ *   seq_ == pos + capacity           consumed, free for the next lap
+ *
+ * After claiming a position the owner writes (or reads) the pointer and
+ * stores the next sequence number with release semantics. There is no lock
+ * and no shared counter besides head_ and tail_, which live on separate
+ * cache lines.
+ *
+ * Batch variants check how many consecutive cells are ready and claim all
+ * of them with a single compare and swap: a cell ready for a position can
+ * only change once that position is claimed, so the check stays valid.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define SPIN_LIMIT 64
+
+struct mpmc_cell {
+
+        _Atomic size_t seq_;
+        void *elem_;
+} __cache_aligned;
+
+struct mpmc_queue {
+
+        /* producers side */
+        _Atomic size_t tail_ __cache_aligned;
+
+        /* consumers side */
+        _Atomic size_t head_ __cache_aligned;
+
+        /* read only after init */
+        size_t mask_ __cache_aligned;
+        struct mpmc_cell *cells_;
+};
+
+/* busy wait a bit, then let other threads run */
+static void backoff(int *spins) {
+
+        if ((*spins)++ < SPIN_LIMIT)
+                cpu_relax();
+        else
+                sched_yield();
+}
+
+void Mpmc_queue_init(mpmc_queue_t *q, int capacity) {
+
+        size_t size = 2, i;
+        void *ptr;
+
+        if (capacity < 1)
+                capacity = 1;
+
+        while (size < (size_t)capacity)
+                size <<= 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct mpmc_queue))) {
+                *q = NULL;
+                return;
+        }
+        *q = (struct mpmc_queue *)ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, size * sizeof(struct mpmc_cell))) {
+                free(*q);
+                *q = NULL;
+                return;
+        }
+        (*q)->cells_ = (struct mpmc_cell *)ptr;
+        (*q)->mask_ = size - 1;
+
+        for (i = 0; i < size; i++) {
+                atomic_init(&(*q)->cells_[i].seq_, i);
+                (*q)->cells_[i].elem_ = NULL;
+        }
+
+        atomic_init(&(*q)->tail_, 0);
+        atomic_init(&(*q)->head_, 0);
+}
+
+void Mpmc_queue_fini(mpmc_queue_t *q) {
+
+        CHECK_PTR(*q);
+
+        free((*q)->cells_);
+        free(*q);
+        *q = NULL;
+}
+
+int Mpmc_queue_try_push_n(mpmc_queue_t q, void **elems, int n) {
+
+        struct mpmc_cell *cell;
+        size_t pos, seq;
+        intptr_t diff;
+        int i, ready;
+
+        if ((q == NULL) || (n <= 0))
+                return 0;
+
+        pos = atomic_load_explicit(&q->tail_, memory_order_relaxed);
+        for (;;) {
+                /* count free cells from pos on */
+                for (ready = 0; ready < n; ready++) {
+                        cell = &q->cells_[(pos + ready) & q->mask_];
+                        seq = atomic_load_explicit(&cell->seq_, memory_order_acquire);
+                        diff = (intptr_t)seq - (intptr_t)(pos + ready);
+                        if (diff != 0)
+                                break;
+                }
+
+                if (ready > 0) {
+                        if (atomic_compare_exchange_weak_explicit(&q->tail_, &pos, pos + ready,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed))
+                                break;
+                        /* pos reloaded by the failed CAS */
+                }
+                else if (diff < 0)
+                        /* full */
+                        return 0;
+                else
+                        /* another producer claimed pos */
+                        pos = atomic_load_explicit(&q->tail_, memory_order_relaxed);
+        }
+
+        /* fill and publish the claimed cells */
+        for (i = 0; i < ready; i++) {
+                cell = &q->cells_[(pos + i) & q->mask_];
+                cell->elem_ = elems[i];
+                atomic_store_explicit(&cell->seq_, pos + i + 1, memory_order_release);
+        }
+
+        return ready;
+}
+
+int Mpmc_queue_try_pop_n(mpmc_queue_t q, void **elems, int n) {
+
+        struct mpmc_cell *cell;
+        size_t pos, seq;
+        intptr_t diff;
+        int i, ready;
+
+        if ((q == NULL) || (n <= 0))
+                return 0;
+
+        pos = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        for (;;) {
+                /* count full cells from pos on */
+                for (ready = 0; ready < n; ready++) {
+                        cell = &q->cells_[(pos + ready) & q->mask_];
+                        seq = atomic_load_explicit(&cell->seq_, memory_order_acquire);
+                        diff = (intptr_t)seq - (intptr_t)(pos + ready + 1);
+                        if (diff != 0)
+                                break;
+                }
+
+                if (ready > 0) {
+                        if (atomic_compare_exchange_weak_explicit(&q->head_, &pos, pos + ready,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed))
+                                break;
+                }
+                else if (diff < 0)
+                        /* empty */
+                        return 0;
+                else
+                        /* another consumer claimed pos */
+                        pos = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        }
+
+        /* read and release the claimed cells for the next lap */
+        for (i = 0; i < ready; i++) {
+                cell = &q->cells_[(pos + i) & q->mask_];
+                elems[i] = cell->elem_;
+                atomic_store_explicit(&cell->seq_, pos + i + q->mask_ + 1, memory_order_release);
+        }
+
+        return ready;
+}
+
+bool Mpmc_queue_try_push(mpmc_queue_t q, void *elem) {
+
+        return Mpmc_queue_try_push_n(q, &elem, 1) == 1;
+}
+
+bool Mpmc_queue_try_pop(mpmc_queue_t q, void **elem) {
+
+        return Mpmc_queue_try_pop_n(q, elem, 1) == 1;
+}
+
+void Mpmc_queue_push(mpmc_queue_t q, void *elem) {
+
+        int spins = 0;
+
+        CHECK_PTR(q);
+
+        /* wait for a free cell */
+        while (!Mpmc_queue_try_push(q, elem))
+                backoff(&spins);
+}
+
+void *Mpmc_queue_pop(mpmc_queue_t q) {
+
+        void *elem;
+        int spins = 0;
+
+        if (q == NULL)
+                return NULL;
+
+        /* wait for a full cell */
+        while (!Mpmc_queue_try_pop(q, &elem))
+                backoff(&spins);
+
+        return elem;
+}
+
+int Mpmc_queue_size(mpmc_queue_t q) {
+
+        size_t head = atomic_load_explicit(&q->head_, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&q->tail_, memory_order_acquire);
+
+        /* a snapshot only, head may pass the tail read before it */
+        return (tail > head) ? (int)(tail - head) : 0;
+}
+
+bool Mpmc_queue_empty(mpmc_queue_t q) {
+
+        return Mpmc_queue_size(q) == 0;
+}
@@ -0,0 +1,19 @@
+#ifndef __MPMC_QUEUE_H__
+#define __MPMC_QUEUE_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct mpmc_queue *mpmc_queue_t;
+
+void Mpmc_queue_init(mpmc_queue_t *, int);
+void Mpmc_queue_fini(mpmc_queue_t *);
+void Mpmc_queue_push(mpmc_queue_t, void *);
+void *Mpmc_queue_pop(mpmc_queue_t);
+bool Mpmc_queue_try_push(mpmc_queue_t, void *);
+bool Mpmc_queue_try_pop(mpmc_queue_t, void **);
+int  Mpmc_queue_try_push_n(mpmc_queue_t, void **, int);
+int  Mpmc_queue_try_pop_n(mpmc_queue_t, void **, int);
+int  Mpmc_queue_size(mpmc_queue_t);
+bool Mpmc_queue_empty(mpmc_queue_t);
+#endif
@@ -0,0 +1,150 @@
+#include <stdatomic.h>
+#include "mpsc_queue.h"
+#include "cache_line.h"
+
+/*
+ * Intrusive queue implementation - valid for many producers and one consumer
+ *
+ * The queue links the struct list_head embedded in the user elements (see
+ * queue_element.h) through their next pointer; prev is not used. Nothing is
+ * allocated on push or pop, the caller gets its element back with
+ * list_entry() on the node returned by Mpsc_queue_pop().
+ *
+ * The queue always contains at least one node: when it is first initialised
+ * that is the stub node embedded in the queue itself.
+ *
+ *     head_                          tail_
+ *       |                              |
+ *       v                              v
+ *   +-------+   +-------+   +-------+   +-------+
+ *   | stub  |-->| elem1 |-->| elem2 |-->| elem3 |-->NULL
+ *   +-------+   +-------+   +-------+   +-------+
+ *
+ * Mpsc_queue_push(q, node) (any producer, wait free):
+ *  - node->next = NULL
+ *  - prev = exchange(tail_, node)
+ *  - prev->next = node, with release semantics
+ *
+ * Between the exchange and the store the chain is broken at prev: the
+ * consumer sees tail_ != head_ but no next and returns NULL until the
+ * producer completes its push, without ever blocking the other producers.
+ *
+ * Mpsc_queue_pop(q) (consumer only) skips the stub and returns head_ once
+ * head_->next is set. When head_ is the last node the stub is pushed back
+ * behind it, so the last element can be returned as well.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+/*
+ * list_head.next is a plain pointer shared with list.h, so it is accessed
+ * with the GCC __atomic builtins, defined on plain objects, rather than
+ * cast to an _Atomic pointer whose layout C11 does not guarantee
+ */
+#define LOAD_NEXT(node, order)        __atomic_load_n(&(node)->next, order)
+#define STORE_NEXT(node, val, order)  __atomic_store_n(&(node)->next, val, order)
+
+struct mpsc_queue {
+
+        /* producers side */
+        struct list_head *_Atomic tail_ __cache_aligned;
+
+        /* consumer side */
+        struct list_head *head_ __cache_aligned;
+        struct list_head stub_;
+};
+
+void Mpsc_queue_init(mpsc_queue_t *q) {
+
+        void *ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct mpsc_queue))) {
+                *q = NULL;
+                return;
+        }
+        *q = (struct mpsc_queue *)ptr;
+
+        (*q)->stub_.next = NULL;
+        (*q)->stub_.prev = NULL;
+        (*q)->head_ = &(*q)->stub_;
+        atomic_init(&(*q)->tail_, &(*q)->stub_);
+}
+
+void Mpsc_queue_fini(mpsc_queue_t *q) {
+
+        CHECK_PTR(*q);
+
+        /* elements still queued belong to the user */
+        free(*q);
+        *q = NULL;
+}
+
+void Mpsc_queue_push(mpsc_queue_t q, struct list_head *node) {
+
+        struct list_head *prev;
+
+        CHECK_PTR(q);
+
+        STORE_NEXT(node, NULL, __ATOMIC_RELAXED);
+
+        /* serialise producers on tail_ */
+        prev = atomic_exchange_explicit(&q->tail_, node, memory_order_acq_rel);
+
+        /* link node to the consumer */
+        STORE_NEXT(prev, node, __ATOMIC_RELEASE);
+}
+
+struct list_head *Mpsc_queue_pop(mpsc_queue_t q) {
+
+        struct list_head *head, *next;
+
+        if (q == NULL)
+                return NULL;
+
+        head = q->head_;
+        next = LOAD_NEXT(head, __ATOMIC_ACQUIRE);
+
+        /* skip the stub */
+        if (head == &q->stub_) {
+                if (next == NULL)
+                        return NULL;
+                q->head_ = next;
+                head = next;
+                next = LOAD_NEXT(next, __ATOMIC_ACQUIRE);
+        }
+
+        if (next != NULL) {
+                q->head_ = next;
+                return head;
+        }
+
+        /* a producer is between exchange and link */
+        if (head != atomic_load_explicit(&q->tail_, memory_order_acquire))
+                return NULL;
+
+        /* head is the last node: put the stub behind it */
+        Mpsc_queue_push(q, &q->stub_);
+
+        next = LOAD_NEXT(head, __ATOMIC_ACQUIRE);
+        if (next != NULL) {
+                q->head_ = next;
+                return head;
+        }
+
+        return NULL;
+}
+
+bool Mpsc_queue_empty(mpsc_queue_t q) {
+
+        struct list_head *head = q->head_;
+
+        /* any node but the stub is an element waiting to be popped */
+        if (head != &q->stub_)
+                return false;
+
+        return LOAD_NEXT(head, __ATOMIC_ACQUIRE) == NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+
+#include "list.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+/*
+ * elements embed a struct list_head; the queue uses only its next field,
+ * read and written with __atomic builtins, and leaves prev alone
+ */
+typedef struct mpsc_queue *mpsc_queue_t;
+
+void Mpsc_queue_init(mpsc_queue_t *);
+void Mpsc_queue_fini(mpsc_queue_t *);
+void Mpsc_queue_push(mpsc_queue_t, struct list_head *);
+struct list_head *Mpsc_queue_pop(mpsc_queue_t);
+bool Mpsc_queue_empty(mpsc_queue_t);
+#endif
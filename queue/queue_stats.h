@@ -0,0 +1,46 @@
+#ifndef __QUEUE_STATS_H__
+#define __QUEUE_STATS_H__
+
+/*
+ * Queue statistics are compiled in only when ATOMIC_QUEUE_STATS is
+ * defined, otherwise QUEUE_STAT() expands to nothing and the queues carry
+ * no extra counter state. pushes and pops come from the element counts
+ * the queue keeps anyway and are always filled in; without the flag every
+ * other field of a snapshot reads as zero.
+ */
+#ifdef ATOMIC_QUEUE_STATS
+#define QUEUE_STAT(stmt) do { stmt; } while (0)
+#else
+#define QUEUE_STAT(stmt) do { } while (0)
+#endif
+
+#define QUEUE_STATS_SAMPLE  64  /* one push out of QUEUE_STATS_SAMPLE is sampled */
+#define QUEUE_STATS_BUCKETS 32  /* log2 histogram buckets */
+
+/*
+ * Snapshot of the counters of a queue. Bucket i of the histograms counts
+ * values v with 2^(i-1) <= v < 2^i, bucket 0 counts zeros.
+ */
+struct queue_stats {
+
+        /* producer side */
+        unsigned long pushes;
+        unsigned long push_full;                       /* pushes that found no room, always 0
+                                                          for the unbounded atomic queue */
+        unsigned long allocs;                          /* slots/envelops allocated */
+        unsigned long wakes;                           /* futex wakes of a parked consumer */
+        unsigned long high_water;                      /* highest sampled occupancy */
+        unsigned long occupancy[QUEUE_STATS_BUCKETS];  /* sampled occupancy at push */
+
+        /* consumer side */
+        unsigned long pops;
+        unsigned long pop_empty;                       /* pops that found nothing */
+        unsigned long spins;                           /* pop_wait busy wait rounds */
+        unsigned long yields;                          /* pop_wait sched_yield calls */
+        unsigned long parks;                           /* pop_wait futex waits */
+        unsigned long latency_samples;
+        unsigned long latency_max_ns;
+        unsigned long latency_sum_ns;
+        unsigned long latency[QUEUE_STATS_BUCKETS];    /* sampled push to pop, ns */
+};
+#endif
@@ -0,0 +1,239 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include "ring_queue.h"
+#include "cache_line.h"
+
+/*
+ * Bounded ring queue implementation - valid only for one producer and one consumer
+ *
+ * The queue stores the user pointers in an array of capacity slots, capacity
+ * being rounded up to a power of two so that a slot is selected by masking
+ * a free running index. The producer owns tail_, the consumer owns head_:
+ *
+ *          head_                       tail_
+ *            |                           |
+ *            v                           v
+ *  +-----+-----+-----+-----+-----+-----+-----+-----+
+ *  |     |  a  |  b  |  c  |  d  |  e  |     |     |
+ *  +-----+-----+-----+-----+-----+-----+-----+-----+
+ *
+ * Ring_queue_push(q, f) writes slot tail_ & mask_ and then publishes it by
+ * storing tail_ + 1 with release semantics. Ring_queue_pop(q) releases
+ * slot head_ & mask_ back to the producer by storing head_ + 1 the same way.
+ * Each side reads the index of the other side with acquire semantics, so
+ * the slot contents are visible before the index that publishes them.
+ *
+ * tail_ and head_ live on different cache lines. Each side also keeps a
+ * private copy of the other side's index (head_cache_, tail_cache_) and
+ * refreshes it only when the queue looks full (producer) or empty
+ * (consumer), so as long as the queue is neither, push and pop touch no
+ * line written by the other thread.
+ *
+ * Ring_queue_push_n() and Ring_queue_pop_n() move as many elements as fit
+ * (or are available) and publish them with a single index store.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+struct ring_queue {
+
+        /* producer side */
+        _Atomic size_t tail_ __cache_aligned;
+        size_t head_cache_;
+
+        /* consumer side */
+        _Atomic size_t head_ __cache_aligned;
+        size_t tail_cache_;
+
+        /* read only after init */
+        size_t mask_ __cache_aligned;
+        void **slots_;
+};
+
+void Ring_queue_init(ring_queue_t *q, int capacity) {
+
+        size_t size = 1;
+        void *ptr;
+
+        if (capacity < 1)
+                capacity = 1;
+
+        while (size < (size_t)capacity)
+                size <<= 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct ring_queue))) {
+                *q = NULL;
+                return;
+        }
+        *q = (struct ring_queue *)ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, size * sizeof(void *))) {
+                free(*q);
+                *q = NULL;
+                return;
+        }
+        (*q)->slots_ = (void **)ptr;
+        (*q)->mask_ = size - 1;
+
+        atomic_init(&(*q)->tail_, 0);
+        atomic_init(&(*q)->head_, 0);
+        (*q)->head_cache_ = 0;
+        (*q)->tail_cache_ = 0;
+}
+
+void Ring_queue_fini(ring_queue_t *q) {
+
+        CHECK_PTR(*q);
+
+        free((*q)->slots_);
+        free(*q);
+        *q = NULL;
+}
+
+bool Ring_queue_push(ring_queue_t q, void *elem) {
+
+        size_t tail;
+
+        if (q == NULL)
+                return false;
+
+        tail = atomic_load_explicit(&q->tail_, memory_order_relaxed);
+
+        /* looks full: refresh the consumer index */
+        if (tail - q->head_cache_ > q->mask_) {
+                q->head_cache_ = atomic_load_explicit(&q->head_, memory_order_acquire);
+                if (tail - q->head_cache_ > q->mask_)
+                        return false;
+        }
+
+        q->slots_[tail & q->mask_] = elem;
+
+        /* publish the slot */
+        atomic_store_explicit(&q->tail_, tail + 1, memory_order_release);
+        return true;
+}
+
+int Ring_queue_push_n(ring_queue_t q, void **elems, int n) {
+
+        size_t tail, free_slots;
+        int i;
+
+        if ((q == NULL) || (n <= 0))
+                return 0;
+
+        tail = atomic_load_explicit(&q->tail_, memory_order_relaxed);
+
+        /* not enough room: refresh the consumer index */
+        free_slots = q->mask_ + 1 - (tail - q->head_cache_);
+        if (free_slots < (size_t)n) {
+                q->head_cache_ = atomic_load_explicit(&q->head_, memory_order_acquire);
+                free_slots = q->mask_ + 1 - (tail - q->head_cache_);
+                if (free_slots < (size_t)n)
+                        n = (int)free_slots;
+        }
+
+        for (i = 0; i < n; i++)
+                q->slots_[(tail + i) & q->mask_] = elems[i];
+
+        /* publish all the slots */
+        if (n > 0)
+                atomic_store_explicit(&q->tail_, tail + n, memory_order_release);
+        return n;
+}
+
+int Ring_queue_pop_n(ring_queue_t q, void **elems, int max) {
+
+        size_t head, avail;
+        int i;
+
+        if ((q == NULL) || (max <= 0))
+                return 0;
+
+        head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+
+        /* not enough elements: refresh the producer index */
+        avail = q->tail_cache_ - head;
+        if (avail < (size_t)max) {
+                q->tail_cache_ = atomic_load_explicit(&q->tail_, memory_order_acquire);
+                avail = q->tail_cache_ - head;
+                if (avail < (size_t)max)
+                        max = (int)avail;
+        }
+
+        for (i = 0; i < max; i++)
+                elems[i] = q->slots_[(head + i) & q->mask_];
+
+        /* hand all the slots back to the producer */
+        if (max > 0)
+                atomic_store_explicit(&q->head_, head + max, memory_order_release);
+        return max;
+}
+
+void Ring_queue_pop(ring_queue_t q) {
+
+        size_t head;
+
+        CHECK_PTR(q);
+
+        /* if empty return */
+        if (Ring_queue_empty(q))
+                return;
+
+        /* hand the slot back to the producer */
+        head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        atomic_store_explicit(&q->head_, head + 1, memory_order_release);
+}
+
+int Ring_queue_size(ring_queue_t q) {
+
+        size_t head = atomic_load_explicit(&q->head_, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&q->tail_, memory_order_acquire);
+
+        return (int)(tail - head);
+}
+
+int Ring_queue_capacity(ring_queue_t q) {
+
+        return (int)(q->mask_ + 1);
+}
+
+bool Ring_queue_empty(ring_queue_t q) {
+
+        size_t head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+
+        if (head != q->tail_cache_)
+                return false;
+
+        /* looks empty: refresh the producer index */
+        q->tail_cache_ = atomic_load_explicit(&q->tail_, memory_order_acquire);
+        return head == q->tail_cache_;
+}
+
+void *Ring_queue_front(ring_queue_t q) {
+
+        size_t head;
+
+        /* if empty return NULL */
+        if (Ring_queue_empty(q))
+                return NULL;
+
+        /* return the front element */
+        head = atomic_load_explicit(&q->head_, memory_order_relaxed);
+        return q->slots_[head & q->mask_];
+}
+
+void *Ring_queue_back(ring_queue_t q) {
+
+        size_t tail = atomic_load_explicit(&q->tail_, memory_order_relaxed);
+
+        /* called by the producer: empty if the consumer caught up */
+        if (tail == atomic_load_explicit(&q->head_, memory_order_acquire))
+                return NULL;
+
+        /* return the back element */
+        return q->slots_[(tail - 1) & q->mask_];
+}
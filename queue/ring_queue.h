@@ -0,0 +1,20 @@
+#ifndef __RING_QUEUE_H__
+#define __RING_QUEUE_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct ring_queue *ring_queue_t;
+
+void Ring_queue_init(ring_queue_t *, int);
+void Ring_queue_fini(ring_queue_t *);
+bool Ring_queue_push(ring_queue_t, void *);
+int  Ring_queue_push_n(ring_queue_t, void **, int);
+void Ring_queue_pop(ring_queue_t);
+int  Ring_queue_pop_n(ring_queue_t, void **, int);
+int  Ring_queue_size(ring_queue_t);
+int  Ring_queue_capacity(ring_queue_t);
+bool Ring_queue_empty(ring_queue_t);
+void *Ring_queue_front(ring_queue_t);
+void *Ring_queue_back(ring_queue_t);
+#endif
@@ -0,0 +1,356 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shm_queue.h"
+#include "cache_line.h"
+
+/*
+ * Shared memory queue implementation - valid only for one producer process
+ * and one consumer process
+ *
+ * Same idea as the atomic queue, but the ring lives in a POSIX shared
+ * memory object (shm_open/mmap) so that two processes exchange records
+ * without going through the kernel. The object is laid out as:
+ *
+ *   +--------+------------+------------+------------------------------+
+ *   | header | producer   | consumer   | data, capacity bytes         |
+ *   |        | tail_,pid_ | head_,pid_ |                              |
+ *   +--------+------------+------------+------------------------------+
+ *
+ * each part on its own cache line. The two processes map the object at
+ * different addresses, so records are addressed by their offset in the
+ * data area; Shm_queue_ptr() turns an offset into a local pointer.
+ *
+ * head_ and tail_ are free running byte counters, the data area is a power
+ * of two. Every record starts with an 8 byte header, its length, followed
+ * by the payload rounded up to 8 bytes:
+ *
+ *   ... | len | payload ... | len | payload | PAD ...... |
+ *
+ * A record is never split around the end of the data area: if it does not
+ * fit contiguously the producer fills the tail with a PAD record, which the
+ * consumer skips, and starts again at offset 0. Padding plus record may
+ * then take up to twice the record size, so a record, header included,
+ * may be at most half the capacity; larger reserves fail, even on an empty
+ * queue, rather than succeed only at some offsets.
+ *
+ * producer:                              consumer:
+ *   off = Shm_queue_reserve(q, max)        off = Shm_queue_front(q, &len)
+ *   write max bytes at Shm_queue_ptr()     read len bytes at Shm_queue_ptr()
+ *   Shm_queue_commit(q, len)               Shm_queue_pop(q)
+ *
+ * commit publishes the record with a release store of tail_, pop hands the
+ * bytes back with a release store of head_; each side keeps a private copy
+ * of the other counter and only reads the shared one when it looks full or
+ * empty, so the fast path has no syscall and no shared write but its own.
+ *
+ * Attaching stores the pid of the process in the slot of its role; an
+ * attach finding the slot held by a pid that no longer exists takes it
+ * over, and Shm_queue_peer_alive() checks the other slot the same way.
+ * Nothing is lost with a crashed peer: a record reserved but not committed
+ * by a crashed producer was never published, a record read but not popped
+ * by a crashed consumer is delivered again to the next one.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define SHM_QUEUE_MAGIC 0x53484d51UL
+#define RECORD_PAD      0x80000000U
+#define RECORD_ALIGN    8UL
+
+#define RECORD_SIZE(len) \
+        (sizeof(struct record) + (((len) + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1)))
+
+struct record {
+
+        uint32_t len_;
+        uint32_t flags_;
+};
+
+/* shared, mapped by both processes */
+struct shm_header {
+
+        _Atomic unsigned long magic_;
+        unsigned long capacity_;
+
+        /* producer line */
+        _Atomic unsigned long tail_ __cache_aligned;
+        _Atomic pid_t producer_;
+
+        /* consumer line */
+        _Atomic unsigned long head_ __cache_aligned;
+        _Atomic pid_t consumer_;
+
+        char data_[] __cache_aligned;
+};
+
+/* private to the attached process */
+struct shm_queue {
+
+        struct shm_header *shm_;
+        size_t size_;
+        enum shm_queue_role role_;
+        unsigned long mask_;
+        unsigned long pos_;     /* own counter */
+        unsigned long cache_;   /* copy of the peer counter */
+        unsigned long pending_; /* start of the reserved record */
+};
+
+static bool pid_alive(pid_t pid) {
+
+        return (pid != 0) && ((kill(pid, 0) == 0) || (errno != ESRCH));
+}
+
+static struct record *record_at(shm_queue_t q, unsigned long pos) {
+
+        return (struct record *)(q->shm_->data_ + (pos & q->mask_));
+}
+
+/* claim the slot of our role, taking it over from a crashed process */
+static bool claim_role(_Atomic pid_t *slot) {
+
+        pid_t self = getpid();
+        pid_t pid = atomic_load(slot);
+
+        for (;;) {
+                if (pid_alive(pid))
+                        return false;
+                if (atomic_compare_exchange_weak(slot, &pid, self))
+                        return true;
+        }
+}
+
+int Shm_queue_create(const char *name, size_t capacity) {
+
+        struct shm_header *shm;
+        size_t size;
+        unsigned long cap = CACHE_LINE_SIZE;
+        int fd;
+
+        while (cap < capacity)
+                cap <<= 1;
+        size = sizeof(struct shm_header) + cap;
+
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+                return -1;
+
+        if (ftruncate(fd, size) < 0) {
+                close(fd);
+                shm_unlink(name);
+                return -1;
+        }
+
+        shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (shm == MAP_FAILED) {
+                shm_unlink(name);
+                return -1;
+        }
+
+        /* the object is zero filled, publish it once the capacity is set */
+        shm->capacity_ = cap;
+        atomic_store_explicit(&shm->magic_, SHM_QUEUE_MAGIC, memory_order_release);
+
+        munmap(shm, size);
+        return 0;
+}
+
+int Shm_queue_unlink(const char *name) {
+
+        return shm_unlink(name);
+}
+
+void Shm_queue_attach(shm_queue_t *q, const char *name, enum shm_queue_role role) {
+
+        struct shm_header *shm;
+        struct stat st;
+        int fd;
+
+        *q = NULL;
+
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+                return;
+
+        if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(struct shm_header))) {
+                close(fd);
+                return;
+        }
+
+        shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (shm == MAP_FAILED)
+                return;
+
+        if ((atomic_load_explicit(&shm->magic_, memory_order_acquire) != SHM_QUEUE_MAGIC) ||
+            (sizeof(struct shm_header) + shm->capacity_ != (size_t)st.st_size) ||
+            !claim_role((role == SHM_QUEUE_PRODUCER) ? &shm->producer_ : &shm->consumer_)) {
+                munmap(shm, st.st_size);
+                return;
+        }
+
+        *q = (struct shm_queue *)malloc(sizeof(struct shm_queue));
+        if (*q == NULL) {
+                atomic_store((role == SHM_QUEUE_PRODUCER) ? &shm->producer_ : &shm->consumer_, 0);
+                munmap(shm, st.st_size);
+                return;
+        }
+
+        (*q)->shm_ = shm;
+        (*q)->size_ = st.st_size;
+        (*q)->role_ = role;
+        (*q)->mask_ = shm->capacity_ - 1;
+
+        /* resume from where the previous owner of the role left */
+        if (role == SHM_QUEUE_PRODUCER) {
+                (*q)->pos_ = atomic_load_explicit(&shm->tail_, memory_order_relaxed);
+                (*q)->cache_ = atomic_load_explicit(&shm->head_, memory_order_acquire);
+        } else {
+                (*q)->pos_ = atomic_load_explicit(&shm->head_, memory_order_relaxed);
+                (*q)->cache_ = atomic_load_explicit(&shm->tail_, memory_order_acquire);
+        }
+        (*q)->pending_ = (*q)->pos_;
+}
+
+void Shm_queue_detach(shm_queue_t *q) {
+
+        CHECK_PTR(*q);
+
+        if ((*q)->role_ == SHM_QUEUE_PRODUCER)
+                atomic_store(&(*q)->shm_->producer_, 0);
+        else
+                atomic_store(&(*q)->shm_->consumer_, 0);
+
+        munmap((*q)->shm_, (*q)->size_);
+        free(*q);
+        *q = NULL;
+}
+
+long Shm_queue_reserve(shm_queue_t q, size_t len) {
+
+        unsigned long capacity = q->mask_ + 1;
+        unsigned long need = RECORD_SIZE(len);
+        unsigned long room = capacity - (q->pos_ & q->mask_);
+        unsigned long total = (room < need) ? room + need : need;
+        struct record *pad;
+
+        /* padding + record always fits an empty ring */
+        if ((need > capacity / 2) || (len > UINT32_MAX >> 1))
+                return -1;
+
+        if (q->pos_ + total - q->cache_ > capacity) {
+                q->cache_ = atomic_load_explicit(&q->shm_->head_, memory_order_acquire);
+                if (q->pos_ + total - q->cache_ > capacity)
+                        return -1;
+        }
+
+        /* not enough room before the end, pad it and start over */
+        if (room < need) {
+                pad = record_at(q, q->pos_);
+                pad->len_ = room - sizeof(struct record);
+                pad->flags_ = RECORD_PAD;
+                q->pos_ += room;
+        }
+
+        q->pending_ = q->pos_;
+        record_at(q, q->pos_)->len_ = len;
+        record_at(q, q->pos_)->flags_ = 0;
+
+        return (q->pos_ & q->mask_) + sizeof(struct record);
+}
+
+void Shm_queue_commit(shm_queue_t q, size_t len) {
+
+        struct record *rec = record_at(q, q->pending_);
+
+        /* may commit less than reserved */
+        if (len < rec->len_)
+                rec->len_ = len;
+
+        q->pos_ = q->pending_ + RECORD_SIZE(rec->len_);
+        atomic_store_explicit(&q->shm_->tail_, q->pos_, memory_order_release);
+}
+
+bool Shm_queue_push(shm_queue_t q, const void *buf, size_t len) {
+
+        long off = Shm_queue_reserve(q, len);
+
+        if (off < 0)
+                return false;
+
+        memcpy(q->shm_->data_ + off, buf, len);
+        Shm_queue_commit(q, len);
+        return true;
+}
+
+long Shm_queue_front(shm_queue_t q, size_t *len) {
+
+        struct record *rec;
+
+        for (;;) {
+                if (q->pos_ == q->cache_) {
+                        q->cache_ = atomic_load_explicit(&q->shm_->tail_, memory_order_acquire);
+                        if (q->pos_ == q->cache_)
+                                return -1;
+                }
+
+                rec = record_at(q, q->pos_);
+                if (!(rec->flags_ & RECORD_PAD))
+                        break;
+
+                /* hand the padding back right away */
+                q->pos_ += RECORD_SIZE(rec->len_);
+                atomic_store_explicit(&q->shm_->head_, q->pos_, memory_order_release);
+        }
+
+        if (len)
+                *len = rec->len_;
+        return (q->pos_ & q->mask_) + sizeof(struct record);
+}
+
+void Shm_queue_pop(shm_queue_t q) {
+
+        CHECK_PTR(q);
+
+        if (Shm_queue_front(q, NULL) < 0)
+                return;
+
+        q->pos_ += RECORD_SIZE(record_at(q, q->pos_)->len_);
+        atomic_store_explicit(&q->shm_->head_, q->pos_, memory_order_release);
+}
+
+void *Shm_queue_ptr(shm_queue_t q, long off) {
+
+        return q->shm_->data_ + off;
+}
+
+bool Shm_queue_empty(shm_queue_t q) {
+
+        if (q->role_ == SHM_QUEUE_CONSUMER)
+                return Shm_queue_front(q, NULL) < 0;
+
+        return atomic_load_explicit(&q->shm_->head_, memory_order_acquire) == q->pos_;
+}
+
+bool Shm_queue_peer_alive(shm_queue_t q) {
+
+        pid_t pid;
+
+        if (q->role_ == SHM_QUEUE_PRODUCER)
+                pid = atomic_load(&q->shm_->consumer_);
+        else
+                pid = atomic_load(&q->shm_->producer_);
+
+        return pid_alive(pid);
+}
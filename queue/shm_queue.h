@@ -0,0 +1,26 @@
+#ifndef __SHM_QUEUE_H__
+#define __SHM_QUEUE_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct shm_queue *shm_queue_t;
+
+enum shm_queue_role {
+        SHM_QUEUE_PRODUCER,
+        SHM_QUEUE_CONSUMER
+};
+
+int  Shm_queue_create(const char *, size_t);
+int  Shm_queue_unlink(const char *);
+void Shm_queue_attach(shm_queue_t *, const char *, enum shm_queue_role);
+void Shm_queue_detach(shm_queue_t *);
+long Shm_queue_reserve(shm_queue_t, size_t);
+void Shm_queue_commit(shm_queue_t, size_t);
+bool Shm_queue_push(shm_queue_t, const void *, size_t);
+long Shm_queue_front(shm_queue_t, size_t *);
+void Shm_queue_pop(shm_queue_t);
+void *Shm_queue_ptr(shm_queue_t, long);
+bool Shm_queue_empty(shm_queue_t);
+bool Shm_queue_peer_alive(shm_queue_t);
+#endif
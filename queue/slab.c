@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "slab.h"
+#include "cache_line.h"
+
+/*
+ * Per-thread slab allocator for queue elements
+ *
+ * Elements malloc'ed by a producer and freed by a consumer make the two
+ * threads fight over the same glibc arena. A slab instead hands out fixed
+ * size objects to a single owner thread, the one calling Slab_init(), from
+ * chunks of CHUNK_SIZE bytes aligned to their size, so that the chunk, and
+ * through its header the slab, of any object is found by masking its
+ * address:
+ *
+ *   chunk (CHUNK_SIZE aligned)
+ *   +--------+-------+-------+-------+-----     -----+
+ *   | header | obj_0 | obj_1 | obj_2 |  ...  free    |
+ *   | slab_  |       |       |       |               |
+ *   +--------+-------+-------+-------+-----     -----+
+ *                                     ^bump_         ^end_
+ *
+ * Free objects are linked through their first word. The owner allocates
+ * from its private free list, then from the remote list, then by carving
+ * the current chunk, then from a new chunk; memory goes back to the system
+ * only in Slab_fini().
+ *
+ * Slab_free() by the owner pushes on the private free list. Any other
+ * thread collects the object in a thread local pending batch, one per
+ * slab in a small direct mapped table, and returns the batch once it holds
+ * BATCH_SIZE objects with a single compare and swap on the slab remote
+ * list. The owner takes the whole remote list with one exchange when its
+ * private list runs dry. Remote pushes only add and the owner only takes
+ * everything, so there is no ABA. Nothing is shared per object: one
+ * atomic operation each side every BATCH_SIZE objects.
+ *
+ * Pending objects are invisible to the owner until returned: Slab_flush()
+ * returns those of the calling thread, which should do it before it goes
+ * idle; a thread exiting returns its batches automatically. Slab_fini()
+ * may be called once every object is back with the owner or pending in
+ * the calling thread; batches still pending elsewhere would be returned
+ * to freed memory.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define CHUNK_SIZE    (64 * 1024)
+#define OBJECT_ALIGN  16
+#define BATCH_SIZE    32
+#define PENDING_SLOTS 8
+
+struct chunk {
+
+        struct slab *slab_;
+        struct chunk *next_;
+} __cache_aligned;
+
+struct slab {
+
+        /* owner side */
+        void *free_ __cache_aligned;
+        char *bump_;
+        char *end_;
+        struct chunk *chunks_;
+        size_t size_;
+        pthread_t owner_;
+
+        /* remote side */
+        void *_Atomic remote_ __cache_aligned;
+};
+
+/* objects freed by this thread on behalf of another one */
+struct pending {
+
+        struct slab *slab_;
+        void *head_;
+        void *tail_;
+        int count_;
+};
+
+static _Thread_local struct pending pending_[PENDING_SLOTS];
+static _Thread_local bool registered_ = false;
+static pthread_key_t exit_key_;
+static pthread_once_t exit_once_ = PTHREAD_ONCE_INIT;
+
+static inline void *next_of(void *obj) {
+
+        return *(void **)obj;
+}
+
+static inline void set_next(void *obj, void *next) {
+
+        *(void **)obj = next;
+}
+
+/* return a pending batch to its slab */
+static void flush_pending(struct pending *p) {
+
+        void *old;
+
+        old = atomic_load_explicit(&p->slab_->remote_, memory_order_relaxed);
+        do {
+                set_next(p->tail_, old);
+        } while (!atomic_compare_exchange_weak_explicit(&p->slab_->remote_, &old, p->head_,
+                                                        memory_order_release, memory_order_relaxed));
+
+        p->head_ = p->tail_ = NULL;
+        p->count_ = 0;
+}
+
+static void exit_flush(void *arg) {
+
+        (void)arg;
+        Slab_flush(NULL);
+}
+
+static void exit_key_create(void) {
+
+        pthread_key_create(&exit_key_, exit_flush);
+}
+
+/* a non owner thread frees obj: add it to the batch of its slab */
+static void remote_free(struct slab *s, void *obj) {
+
+        struct pending *p = &pending_[((uintptr_t)s / sizeof(struct slab)) % PENDING_SLOTS];
+
+        /* flush the batch of the slab on the same slot, if any */
+        if (p->slab_ != s) {
+                if (p->count_ > 0)
+                        flush_pending(p);
+                p->slab_ = s;
+        }
+
+        /* return the batches when the thread exits */
+        if (!registered_) {
+                pthread_once(&exit_once_, exit_key_create);
+                pthread_setspecific(exit_key_, (void *)1);
+                registered_ = true;
+        }
+
+        set_next(obj, p->head_);
+        if (p->head_ == NULL)
+                p->tail_ = obj;
+        p->head_ = obj;
+
+        if (++p->count_ >= BATCH_SIZE)
+                flush_pending(p);
+}
+
+static bool new_chunk(struct slab *s) {
+
+        struct chunk *chunk;
+        void *ptr;
+
+        if (posix_memalign(&ptr, CHUNK_SIZE, CHUNK_SIZE))
+                return false;
+
+        chunk = (struct chunk *)ptr;
+        chunk->slab_ = s;
+        chunk->next_ = s->chunks_;
+        s->chunks_ = chunk;
+        s->bump_ = (char *)ptr + sizeof(struct chunk);
+        s->end_ = (char *)ptr + CHUNK_SIZE;
+        return true;
+}
+
+void Slab_init(slab_t *s, size_t size) {
+
+        void *ptr;
+
+        /* room for the free list link, rounded to the object alignment */
+        if (size < sizeof(void *))
+                size = sizeof(void *);
+        size = (size + OBJECT_ALIGN - 1) & ~(size_t)(OBJECT_ALIGN - 1);
+
+        if ((size > CHUNK_SIZE - sizeof(struct chunk)) ||
+            posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct slab))) {
+                *s = NULL;
+                return;
+        }
+        *s = (struct slab *)ptr;
+
+        (*s)->free_ = NULL;
+        (*s)->bump_ = (*s)->end_ = NULL;
+        (*s)->chunks_ = NULL;
+        (*s)->size_ = size;
+        (*s)->owner_ = pthread_self();
+        atomic_init(&(*s)->remote_, NULL);
+}
+
+void Slab_fini(slab_t *s) {
+
+        struct chunk *chunk, *next;
+        int i;
+
+        CHECK_PTR(*s);
+
+        /* forget what the calling thread did not return yet */
+        for (i = 0; i < PENDING_SLOTS; i++) {
+                if (pending_[i].slab_ == *s) {
+                        pending_[i].slab_ = NULL;
+                        pending_[i].head_ = pending_[i].tail_ = NULL;
+                        pending_[i].count_ = 0;
+                }
+        }
+
+        for (chunk = (*s)->chunks_; chunk != NULL; chunk = next) {
+                next = chunk->next_;
+                free(chunk);
+        }
+
+        free(*s);
+        *s = NULL;
+}
+
+void *Slab_alloc(slab_t s) {
+
+        void *obj;
+
+        if (s == NULL)
+                return NULL;
+
+        /* take back what other threads returned */
+        if ((s->free_ == NULL) && (atomic_load_explicit(&s->remote_, memory_order_relaxed) != NULL))
+                s->free_ = atomic_exchange_explicit(&s->remote_, NULL, memory_order_acquire);
+
+        if (s->free_ != NULL) {
+                obj = s->free_;
+                s->free_ = next_of(obj);
+                return obj;
+        }
+
+        /* carve the current chunk */
+        if (((size_t)(s->end_ - s->bump_) < s->size_) && !new_chunk(s))
+                return NULL;
+
+        obj = s->bump_;
+        s->bump_ += s->size_;
+        return obj;
+}
+
+void Slab_free(void *obj) {
+
+        struct slab *s;
+
+        CHECK_PTR(obj);
+
+        s = ((struct chunk *)((uintptr_t)obj & ~(uintptr_t)(CHUNK_SIZE - 1)))->slab_;
+
+        if (pthread_equal(s->owner_, pthread_self())) {
+                set_next(obj, s->free_);
+                s->free_ = obj;
+        }
+        else
+                remote_free(s, obj);
+}
+
+void Slab_flush(slab_t s) {
+
+        int i;
+
+        /* NULL: the batches of every slab */
+        for (i = 0; i < PENDING_SLOTS; i++)
+                if ((pending_[i].count_ > 0) && ((s == NULL) || (pending_[i].slab_ == s)))
+                        flush_pending(&pending_[i]);
+}
@@ -0,0 +1,13 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <stdlib.h>
+
+typedef struct slab *slab_t;
+
+void Slab_init(slab_t *, size_t);
+void Slab_fini(slab_t *);
+void *Slab_alloc(slab_t);
+void Slab_free(void *);
+void Slab_flush(slab_t);
+#endif
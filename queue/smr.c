@@ -0,0 +1,486 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "smr.h"
+#include "cache_line.h"
+
+/*
+ * Safe memory reclamation for lock-free structures
+ *
+ * A node unlinked from a lock-free structure cannot be freed right away,
+ * another thread may still be reading it. Instead it is retired, together
+ * with the function that frees it, and freed once no thread can hold a
+ * reference any more. Two schemes are provided, both keeping a record per
+ * thread (found through a pthread key, reused after the thread exits) with
+ * a private list of retired nodes freed in batches:
+ *
+ * Epoch based reclamation (Ebr_*), for throughput. Readers bracket their
+ * accesses with Ebr_enter()/Ebr_exit(), which only publish the global
+ * epoch in the thread record. Nodes are retired in the bucket of the
+ * current epoch:
+ *
+ *   epoch:     e-2         e-1          e
+ *           +-------+   +-------+   +-------+
+ *   limbo:  | free  |   | wait  |   | wait  |   <- Ebr_retire()
+ *           +-------+   +-------+   +-------+
+ *
+ * Every EBR_BATCH retires the thread tries to advance the epoch, which
+ * succeeds only when every thread inside a critical section has seen the
+ * current one; nodes retired two epochs ago are then unreachable. A thread
+ * stalled inside a critical section blocks all reclamation.
+ *
+ * Hazard pointers (Hp_*), for bounded garbage. A reader publishes each
+ * pointer it is about to dereference in one of its hazard slots with
+ * Hp_protect(), which rereads the source until it is stable. When the
+ * retired list of a thread grows past a threshold proportional to the
+ * number of hazard slots, the thread collects all published hazards and
+ * frees every retired node not among them, so at most a bounded number of
+ * nodes per thread is ever waiting, whatever the other threads do.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define EBR_BATCH 64
+#define HP_BATCH  64
+
+struct retired {
+
+        void *ptr_;
+        void (*free_)(void *);
+};
+
+struct retired_list {
+
+        struct retired *items_;
+        int count_;
+        int size_;
+        unsigned long epoch_;
+};
+
+/* common head of ebr and hp thread records */
+struct smr_rec {
+
+        struct smr_rec *next_;
+        _Atomic bool used_;
+        void *domain_;
+};
+
+struct ebr_rec {
+
+        struct smr_rec rec_;
+        _Atomic unsigned long epoch_; /* epoch << 1 | inside critical section */
+        int nesting_;
+        int pending_;
+        struct retired_list limbo_[3];
+} __cache_aligned;
+
+struct ebr {
+
+        _Atomic unsigned long epoch_ __cache_aligned;
+        struct smr_rec *_Atomic recs_ __cache_aligned;
+        _Atomic int count_;
+        pthread_key_t key_;
+};
+
+struct hp_rec {
+
+        struct smr_rec rec_;
+        struct retired_list retired_;
+        void *_Atomic slots_[];
+};
+
+struct hp {
+
+        struct smr_rec *_Atomic recs_ __cache_aligned;
+        _Atomic int count_;
+        int slots_;
+        pthread_key_t key_;
+};
+
+static void list_push(struct retired_list *l, void *ptr, void (*fn)(void *)) {
+
+        struct retired *items;
+        int size;
+
+        if (l->count_ == l->size_) {
+                size = l->size_ ? l->size_ * 2 : EBR_BATCH;
+                items = (struct retired *)realloc(l->items_, size * sizeof(struct retired));
+                if (items == NULL) {
+                        /* out of memory: leak rather than free a live node */
+                        return;
+                }
+                l->items_ = items;
+                l->size_ = size;
+        }
+
+        l->items_[l->count_].ptr_ = ptr;
+        l->items_[l->count_].free_ = fn;
+        l->count_++;
+}
+
+static void list_free(struct retired_list *l) {
+
+        int i;
+
+        for (i = 0; i < l->count_; i++)
+                l->items_[i].free_(l->items_[i].ptr_);
+        l->count_ = 0;
+}
+
+/* take the record of a thread that exited, or add a new one */
+static struct smr_rec *acquire_rec(struct smr_rec *_Atomic *recs, _Atomic int *count,
+                                   size_t size, void *domain) {
+
+        struct smr_rec *rec;
+        void *ptr;
+        bool used;
+
+        for (rec = atomic_load_explicit(recs, memory_order_acquire); rec != NULL; rec = rec->next_) {
+                used = false;
+                if (!atomic_load_explicit(&rec->used_, memory_order_relaxed) &&
+                    atomic_compare_exchange_strong(&rec->used_, &used, true))
+                        return rec;
+        }
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, size))
+                return NULL;
+        memset(ptr, 0, size);
+
+        rec = (struct smr_rec *)ptr;
+        rec->domain_ = domain;
+        atomic_init(&rec->used_, true);
+
+        rec->next_ = atomic_load_explicit(recs, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(recs, &rec->next_, rec,
+                                                      memory_order_release,
+                                                      memory_order_relaxed))
+                ;
+        atomic_fetch_add_explicit(count, 1, memory_order_relaxed);
+
+        return rec;
+}
+
+/*
+ * Epoch based reclamation
+ */
+
+static unsigned long ebr_advance(ebr_t ebr) {
+
+        unsigned long epoch = atomic_load(&ebr->epoch_);
+        unsigned long seen;
+        struct smr_rec *rec;
+
+        atomic_thread_fence(memory_order_seq_cst);
+
+        for (rec = atomic_load_explicit(&ebr->recs_, memory_order_acquire); rec != NULL; rec = rec->next_) {
+                seen = atomic_load_explicit(&((struct ebr_rec *)rec)->epoch_, memory_order_acquire);
+                if ((seen & 1) && ((seen >> 1) != epoch))
+                        return epoch;
+        }
+
+        if (atomic_compare_exchange_strong(&ebr->epoch_, &epoch, epoch + 1))
+                return epoch + 1;
+        return epoch;
+}
+
+static void ebr_collect(ebr_t ebr, struct ebr_rec *rec) {
+
+        unsigned long epoch = ebr_advance(ebr);
+        int i;
+
+        for (i = 0; i < 3; i++)
+                if (rec->limbo_[i].epoch_ + 2 <= epoch)
+                        list_free(&rec->limbo_[i]);
+        rec->pending_ = 0;
+}
+
+static void ebr_release(void *ptr) {
+
+        struct ebr_rec *rec = (struct ebr_rec *)ptr;
+
+        /* free what can be freed, the rest waits for the next owner */
+        ebr_collect((ebr_t)rec->rec_.domain_, rec);
+        rec->nesting_ = 0;
+        atomic_store_explicit(&rec->epoch_, 0, memory_order_release);
+        atomic_store_explicit(&rec->rec_.used_, false, memory_order_release);
+}
+
+static struct ebr_rec *ebr_rec(ebr_t ebr) {
+
+        struct ebr_rec *rec = (struct ebr_rec *)pthread_getspecific(ebr->key_);
+
+        if (rec == NULL) {
+                rec = (struct ebr_rec *)acquire_rec(&ebr->recs_, &ebr->count_,
+                                                    sizeof(struct ebr_rec), ebr);
+                pthread_setspecific(ebr->key_, rec);
+        }
+        return rec;
+}
+
+void Ebr_init(ebr_t *ebr) {
+
+        void *ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct ebr))) {
+                *ebr = NULL;
+                return;
+        }
+        *ebr = (struct ebr *)ptr;
+
+        if (pthread_key_create(&(*ebr)->key_, ebr_release)) {
+                free(*ebr);
+                *ebr = NULL;
+                return;
+        }
+
+        /* limbo lists start tagged with epoch 0, already safe */
+        atomic_init(&(*ebr)->epoch_, 2);
+        atomic_init(&(*ebr)->recs_, NULL);
+        atomic_init(&(*ebr)->count_, 0);
+}
+
+void Ebr_fini(ebr_t *ebr) {
+
+        struct smr_rec *rec, *next;
+        struct ebr_rec *e;
+        int i;
+
+        CHECK_PTR(*ebr);
+
+        pthread_key_delete((*ebr)->key_);
+
+        for (rec = atomic_load(&(*ebr)->recs_); rec != NULL; rec = next) {
+                next = rec->next_;
+                e = (struct ebr_rec *)rec;
+                for (i = 0; i < 3; i++) {
+                        list_free(&e->limbo_[i]);
+                        free(e->limbo_[i].items_);
+                }
+                free(e);
+        }
+
+        free(*ebr);
+        *ebr = NULL;
+}
+
+void Ebr_enter(ebr_t ebr) {
+
+        struct ebr_rec *rec = ebr_rec(ebr);
+        unsigned long epoch;
+
+        if (rec->nesting_++ > 0)
+                return;
+
+        /* announce the epoch before reading any shared pointer */
+        epoch = atomic_load_explicit(&ebr->epoch_, memory_order_relaxed);
+        atomic_store_explicit(&rec->epoch_, (epoch << 1) | 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+}
+
+void Ebr_exit(ebr_t ebr) {
+
+        struct ebr_rec *rec = ebr_rec(ebr);
+
+        if (--rec->nesting_ > 0)
+                return;
+
+        atomic_store_explicit(&rec->epoch_, 0, memory_order_release);
+}
+
+void Ebr_retire(ebr_t ebr, void *ptr, void (*fn)(void *)) {
+
+        struct ebr_rec *rec = ebr_rec(ebr);
+        unsigned long epoch = atomic_load(&ebr->epoch_);
+        struct retired_list *l = &rec->limbo_[epoch % 3];
+
+        /* the bucket holds nodes at least three epochs old */
+        if (l->epoch_ != epoch) {
+                list_free(l);
+                l->epoch_ = epoch;
+        }
+        list_push(l, ptr, fn);
+
+        if (++rec->pending_ >= EBR_BATCH)
+                ebr_collect(ebr, rec);
+}
+
+void Ebr_reclaim(ebr_t ebr) {
+
+        CHECK_PTR(ebr);
+
+        ebr_collect(ebr, ebr_rec(ebr));
+}
+
+/*
+ * Hazard pointers
+ */
+
+static int hp_compare(const void *a, const void *b) {
+
+        uintptr_t x = (uintptr_t)*(void *const *)a;
+        uintptr_t y = (uintptr_t)*(void *const *)b;
+
+        return (x > y) - (x < y);
+}
+
+static void hp_scan(hp_t hp, struct hp_rec *rec) {
+
+        struct smr_rec *r;
+        void **hazards, **grown;
+        void *ptr;
+        int n = 0, size, i, kept = 0;
+
+        atomic_thread_fence(memory_order_seq_cst);
+
+        size = (atomic_load_explicit(&hp->count_, memory_order_relaxed) + 1) * hp->slots_;
+        hazards = (void **)malloc(size * sizeof(void *));
+        if (hazards == NULL)
+                return;
+
+        for (r = atomic_load_explicit(&hp->recs_, memory_order_acquire); r != NULL; r = r->next_) {
+                for (i = 0; i < hp->slots_; i++) {
+                        ptr = atomic_load(&((struct hp_rec *)r)->slots_[i]);
+                        if (ptr == NULL)
+                                continue;
+                        /* records added since count_ was read */
+                        if (n == size) {
+                                grown = (void **)realloc(hazards, 2 * size * sizeof(void *));
+                                if (grown == NULL) {
+                                        free(hazards);
+                                        return;
+                                }
+                                hazards = grown;
+                                size *= 2;
+                        }
+                        hazards[n++] = ptr;
+                }
+        }
+        qsort(hazards, n, sizeof(void *), hp_compare);
+
+        /* free what nobody protects, keep the rest */
+        for (i = 0; i < rec->retired_.count_; i++) {
+                ptr = rec->retired_.items_[i].ptr_;
+                if (bsearch(&ptr, hazards, n, sizeof(void *), hp_compare))
+                        rec->retired_.items_[kept++] = rec->retired_.items_[i];
+                else
+                        rec->retired_.items_[i].free_(ptr);
+        }
+        rec->retired_.count_ = kept;
+
+        free(hazards);
+}
+
+static void hp_release(void *ptr) {
+
+        struct hp_rec *rec = (struct hp_rec *)ptr;
+        hp_t hp = (hp_t)rec->rec_.domain_;
+        int i;
+
+        for (i = 0; i < hp->slots_; i++)
+                atomic_store_explicit(&rec->slots_[i], NULL, memory_order_release);
+        hp_scan(hp, rec);
+        atomic_store_explicit(&rec->rec_.used_, false, memory_order_release);
+}
+
+static struct hp_rec *hp_rec(hp_t hp) {
+
+        struct hp_rec *rec = (struct hp_rec *)pthread_getspecific(hp->key_);
+
+        if (rec == NULL) {
+                rec = (struct hp_rec *)acquire_rec(&hp->recs_, &hp->count_,
+                                                   sizeof(struct hp_rec) + hp->slots_ * sizeof(void *),
+                                                   hp);
+                pthread_setspecific(hp->key_, rec);
+        }
+        return rec;
+}
+
+void Hp_init(hp_t *hp, int slots) {
+
+        void *ptr;
+
+        if (slots < 1)
+                slots = 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct hp))) {
+                *hp = NULL;
+                return;
+        }
+        *hp = (struct hp *)ptr;
+
+        if (pthread_key_create(&(*hp)->key_, hp_release)) {
+                free(*hp);
+                *hp = NULL;
+                return;
+        }
+
+        (*hp)->slots_ = slots;
+        atomic_init(&(*hp)->recs_, NULL);
+        atomic_init(&(*hp)->count_, 0);
+}
+
+void Hp_fini(hp_t *hp) {
+
+        struct smr_rec *rec, *next;
+        struct hp_rec *h;
+
+        CHECK_PTR(*hp);
+
+        pthread_key_delete((*hp)->key_);
+
+        for (rec = atomic_load(&(*hp)->recs_); rec != NULL; rec = next) {
+                next = rec->next_;
+                h = (struct hp_rec *)rec;
+                list_free(&h->retired_);
+                free(h->retired_.items_);
+                free(h);
+        }
+
+        free(*hp);
+        *hp = NULL;
+}
+
+void *Hp_protect(hp_t hp, int slot, void *_Atomic *src) {
+
+        struct hp_rec *rec = hp_rec(hp);
+        void *ptr, *again;
+
+        ptr = atomic_load_explicit(src, memory_order_relaxed);
+        for (;;) {
+                atomic_store(&rec->slots_[slot], ptr);
+
+                /* still there after the hazard is visible: cannot be freed */
+                again = atomic_load(src);
+                if (again == ptr)
+                        return ptr;
+                ptr = again;
+        }
+}
+
+void Hp_clear(hp_t hp, int slot) {
+
+        atomic_store_explicit(&hp_rec(hp)->slots_[slot], NULL, memory_order_release);
+}
+
+void Hp_retire(hp_t hp, void *ptr, void (*fn)(void *)) {
+
+        struct hp_rec *rec = hp_rec(hp);
+
+        list_push(&rec->retired_, ptr, fn);
+
+        if (rec->retired_.count_ >= HP_BATCH + 2 * hp->slots_ * atomic_load(&hp->count_))
+                hp_scan(hp, rec);
+}
+
+void Hp_reclaim(hp_t hp) {
+
+        CHECK_PTR(hp);
+
+        hp_scan(hp, hp_rec(hp));
+}
@@ -0,0 +1,24 @@
+#ifndef __SMR_H__
+#define __SMR_H__
+
+#include <stdlib.h>
+
+typedef struct ebr *ebr_t;
+typedef struct hp *hp_t;
+
+/* epoch based reclamation */
+void Ebr_init(ebr_t *);
+void Ebr_fini(ebr_t *);
+void Ebr_enter(ebr_t);
+void Ebr_exit(ebr_t);
+void Ebr_retire(ebr_t, void *, void (*)(void *));
+void Ebr_reclaim(ebr_t);
+
+/* hazard pointers */
+void Hp_init(hp_t *, int);
+void Hp_fini(hp_t *);
+void *Hp_protect(hp_t, int, void *_Atomic *);
+void Hp_clear(hp_t, int);
+void Hp_retire(hp_t, void *, void (*)(void *));
+void Hp_reclaim(hp_t);
+#endif
@@ -0,0 +1,347 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "thread_pool.h"
+#include "ws_deque.h"
+#include "mpmc_queue.h"
+#include "smr.h"
+#include "cache_line.h"
+
+/*
+ * Work stealing thread pool
+ *
+ * Every worker owns a Chase-Lev deque (ws_deque.c). Tasks spawned by a
+ * worker are pushed at the bottom of its own deque and popped back in LIFO
+ * order, so fork/join recursion stays on the core that created the work;
+ * idle workers steal the oldest tasks from the top of a random victim's
+ * deque. Tasks spawned by threads outside the pool go through a bounded
+ * MPMC injection queue (mpmc_queue.c) that workers poll after their own
+ * deque. Deques share one epoch based reclamation domain (smr.c) for the
+ * arrays they retire when they grow.
+ *
+ * A worker with nothing to run spins, then yields, then parks on a
+ * condition variable. Spawning a task checks sleepers_ after a seq_cst
+ * fence and signals only if some worker is parked; the parking worker
+ * increments sleepers_ and rechecks all queues under the same mutex, so
+ * a task cannot be missed.
+ *
+ * Thread_pool_spawn() runs the task in the calling thread when it cannot
+ * allocate it or its deque cannot grow, so running out of memory degrades
+ * to sequential execution instead of losing tasks.
+ *
+ * Thread_pool_join() does not block: the caller runs or steals tasks until
+ * every task in the group has completed, which makes nested joins inside
+ * tasks safe.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+#define DEQUE_CAPACITY  256
+#define INJECT_CAPACITY 1024
+#define SPIN_LIMIT      64
+#define YIELD_LIMIT     16
+
+struct task {
+
+        void (*function_)(void *);
+        void *arg_;
+        thread_pool_group_t *group_;
+};
+
+struct worker {
+
+        ws_deque_t deque_;
+        struct thread_pool *pool_;
+        uint64_t seed_;
+        pthread_t tid_;
+} __cache_aligned;
+
+struct thread_pool {
+
+        struct worker *workers_;
+        int size_;
+        mpmc_queue_t inject_;
+        ebr_t ebr_;
+
+        /* parking */
+        _Atomic int sleepers_ __cache_aligned;
+        _Atomic bool stop_;
+        pthread_mutex_t lock_;
+        pthread_cond_t cond_;
+};
+
+/* worker the calling thread runs as, NULL outside of any pool */
+static _Thread_local struct worker *self_ = NULL;
+
+static struct worker *current_worker(thread_pool_t pool) {
+
+        return ((self_ != NULL) && (self_->pool_ == pool)) ? self_ : NULL;
+}
+
+static uint64_t next_random(uint64_t *seed) {
+
+        *seed ^= *seed << 13;
+        *seed ^= *seed >> 7;
+        *seed ^= *seed << 17;
+        return *seed;
+}
+
+/* own deque first, then the injection queue, then a round of stealing */
+static struct task *find_task(thread_pool_t pool, struct worker *w) {
+
+        struct task *t = NULL;
+        uint64_t seed = (uint64_t)(uintptr_t)&t;
+        int i, victim;
+
+        if (w != NULL) {
+                t = (struct task *)Ws_deque_pop(w->deque_);
+                if (t != NULL)
+                        return t;
+        }
+
+        if (Mpmc_queue_try_pop(pool->inject_, (void **)&t))
+                return t;
+
+        victim = (int)(next_random(w ? &w->seed_ : &seed) % pool->size_);
+        for (i = 0; i < pool->size_; i++, victim = (victim + 1) % pool->size_) {
+                if (&pool->workers_[victim] == w)
+                        continue;
+                t = (struct task *)Ws_deque_steal(pool->workers_[victim].deque_);
+                if (t != NULL)
+                        return t;
+        }
+
+        return NULL;
+}
+
+static bool has_work(thread_pool_t pool) {
+
+        int i;
+
+        if (!Mpmc_queue_empty(pool->inject_))
+                return true;
+
+        for (i = 0; i < pool->size_; i++)
+                if (!Ws_deque_empty(pool->workers_[i].deque_))
+                        return true;
+
+        return false;
+}
+
+static void run_task(struct task *t) {
+
+        thread_pool_group_t *group = t->group_;
+
+        t->function_(t->arg_);
+        free(t);
+
+        atomic_fetch_sub_explicit(&group->pending_, 1, memory_order_release);
+}
+
+static void wake_worker(thread_pool_t pool) {
+
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if (atomic_load_explicit(&pool->sleepers_, memory_order_relaxed) == 0)
+                return;
+
+        pthread_mutex_lock(&pool->lock_);
+        pthread_cond_signal(&pool->cond_);
+        pthread_mutex_unlock(&pool->lock_);
+}
+
+static void *worker_loop(void *arg) {
+
+        struct worker *w = (struct worker *)arg;
+        thread_pool_t pool = w->pool_;
+        struct task *t;
+        int idle = 0;
+
+        self_ = w;
+
+        for (;;) {
+                t = find_task(pool, w);
+                if (t != NULL) {
+                        run_task(t);
+                        idle = 0;
+                        continue;
+                }
+
+                if (atomic_load_explicit(&pool->stop_, memory_order_acquire))
+                        break;
+
+                /* spin, then yield */
+                if (idle < SPIN_LIMIT) {
+                        idle++;
+                        cpu_relax();
+                        continue;
+                }
+                if (idle < SPIN_LIMIT + YIELD_LIMIT) {
+                        idle++;
+                        sched_yield();
+                        continue;
+                }
+
+                /* then park */
+                pthread_mutex_lock(&pool->lock_);
+                atomic_fetch_add_explicit(&pool->sleepers_, 1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                if (!has_work(pool) && !atomic_load_explicit(&pool->stop_, memory_order_acquire))
+                        pthread_cond_wait(&pool->cond_, &pool->lock_);
+                atomic_fetch_sub_explicit(&pool->sleepers_, 1, memory_order_relaxed);
+                pthread_mutex_unlock(&pool->lock_);
+                idle = 0;
+        }
+
+        self_ = NULL;
+        return NULL;
+}
+
+/* free everything but the worker threads, also after a failed init */
+static void release(thread_pool_t pool) {
+
+        int i;
+
+        for (i = 0; i < pool->size_; i++)
+                Ws_deque_fini(&pool->workers_[i].deque_);
+
+        /* frees the deque arrays retired while growing */
+        Ebr_fini(&pool->ebr_);
+        Mpmc_queue_fini(&pool->inject_);
+        pthread_mutex_destroy(&pool->lock_);
+        pthread_cond_destroy(&pool->cond_);
+        free(pool->workers_);
+        free(pool);
+}
+
+void Thread_pool_init(thread_pool_t *pool, int nthreads) {
+
+        void *ptr;
+        bool ok = true;
+        int i;
+
+        if (nthreads < 1)
+                nthreads = 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct thread_pool))) {
+                *pool = NULL;
+                return;
+        }
+        *pool = (struct thread_pool *)ptr;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, nthreads * sizeof(struct worker))) {
+                free(*pool);
+                *pool = NULL;
+                return;
+        }
+        (*pool)->workers_ = (struct worker *)ptr;
+        (*pool)->size_ = nthreads;
+        Mpmc_queue_init(&(*pool)->inject_, INJECT_CAPACITY);
+        Ebr_init(&(*pool)->ebr_);
+
+        atomic_init(&(*pool)->sleepers_, 0);
+        atomic_init(&(*pool)->stop_, false);
+        pthread_mutex_init(&(*pool)->lock_, NULL);
+        pthread_cond_init(&(*pool)->cond_, NULL);
+
+        /* create every deque before any worker may steal from it */
+        for (i = 0; i < nthreads; i++) {
+                Ws_deque_init(&(*pool)->workers_[i].deque_, DEQUE_CAPACITY, (*pool)->ebr_);
+                (*pool)->workers_[i].pool_ = *pool;
+                (*pool)->workers_[i].seed_ = 0x9E3779B97F4A7C15ULL * (i + 1);
+                ok = ok && ((*pool)->workers_[i].deque_ != NULL);
+        }
+
+        if (!ok || ((*pool)->inject_ == NULL) || ((*pool)->ebr_ == NULL)) {
+                release(*pool);
+                *pool = NULL;
+                return;
+        }
+
+        for (i = 0; i < nthreads; i++)
+                pthread_create(&(*pool)->workers_[i].tid_, NULL, worker_loop, &(*pool)->workers_[i]);
+}
+
+void Thread_pool_fini(thread_pool_t *pool) {
+
+        int i;
+
+        CHECK_PTR(*pool);
+
+        /* workers exit once they find no more tasks */
+        pthread_mutex_lock(&(*pool)->lock_);
+        atomic_store_explicit(&(*pool)->stop_, true, memory_order_release);
+        pthread_cond_broadcast(&(*pool)->cond_);
+        pthread_mutex_unlock(&(*pool)->lock_);
+
+        for (i = 0; i < (*pool)->size_; i++)
+                pthread_join((*pool)->workers_[i].tid_, NULL);
+
+        release(*pool);
+        *pool = NULL;
+}
+
+void Thread_pool_spawn(thread_pool_t pool, thread_pool_group_t *group, void (*function)(void *), void *arg) {
+
+        struct worker *w;
+        struct task *t;
+
+        CHECK_PTR(pool);
+
+        /* out of memory: run the task right away, the group never sees it */
+        t = (struct task *)malloc(sizeof(struct task));
+        if (t == NULL) {
+                function(arg);
+                return;
+        }
+        t->function_ = function;
+        t->arg_ = arg;
+        t->group_ = group;
+        atomic_fetch_add_explicit(&group->pending_, 1, memory_order_relaxed);
+
+        /* workers push on their own deque, other threads inject */
+        w = current_worker(pool);
+        if (w == NULL)
+                Mpmc_queue_push(pool->inject_, t);
+        else if (!Ws_deque_push(w->deque_, t)) {
+                /* full deque that cannot grow: run it here as well */
+                run_task(t);
+                return;
+        }
+
+        wake_worker(pool);
+}
+
+void Thread_pool_join(thread_pool_t pool, thread_pool_group_t *group) {
+
+        struct worker *w;
+        struct task *t;
+        int idle = 0;
+
+        CHECK_PTR(pool);
+
+        w = current_worker(pool);
+
+        /* help running tasks until the group is done */
+        while (atomic_load_explicit(&group->pending_, memory_order_acquire) > 0) {
+                t = find_task(pool, w);
+                if (t != NULL) {
+                        run_task(t);
+                        idle = 0;
+                }
+                else if (idle++ < SPIN_LIMIT)
+                        cpu_relax();
+                else
+                        sched_yield();
+        }
+}
+
+int Thread_pool_size(thread_pool_t pool) {
+
+        return pool->size_;
+}
@@ -0,0 +1,21 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct thread_pool *thread_pool_t;
+
+/* set of spawned tasks a caller can join */
+typedef struct thread_pool_group {
+        _Atomic long pending_;
+} thread_pool_group_t;
+
+#define THREAD_POOL_GROUP_INIT { 0 }
+
+void Thread_pool_init(thread_pool_t *, int);
+void Thread_pool_fini(thread_pool_t *);
+void Thread_pool_spawn(thread_pool_t, thread_pool_group_t *, void (*)(void *), void *);
+void Thread_pool_join(thread_pool_t, thread_pool_group_t *);
+int  Thread_pool_size(thread_pool_t);
+#endif
@@ -0,0 +1,248 @@
+#include <stdatomic.h>
+#include "ws_deque.h"
+#include "cache_line.h"
+
+/*
+ * Work stealing deque implementation - one owner, many thieves
+ *
+ * Chase-Lev deque with the C11 memory orderings of Le, Pop, Cohen and
+ * Zappa Nardelli ("Correct and Efficient Work-Stealing for Weak Memory
+ * Models", PPoPP 2013). The owner pushes and pops at bottom_, thieves
+ * steal at top_:
+ *
+ *              top_                    bottom_
+ *               |                         |
+ *               v                         v
+ *   +-----+-----+-----+-----+-----+-----+-----+-----+
+ *   |     |     |  a  |  b  |  c  |  d  |     |     |
+ *   +-----+-----+-----+-----+-----+-----+-----+-----+
+ *           steal <--                 --> push/pop
+ *
+ * The array is circular and indexed by free running signed indices.
+ * When the owner finds it full it copies the live elements into an array
+ * twice as large and publishes it; thieves may still be reading the old
+ * array, so it is retired to the epoch based reclamation domain given to
+ * Ws_deque_init() (smr.c) and thieves steal inside a critical section.
+ * Without a domain retired arrays are kept on a list and freed by
+ * Ws_deque_fini().
+ *
+ * Ws_deque_push() returns false, leaving the deque as it was, if the
+ * array is full and the larger one cannot be allocated.
+ *
+ * Only the last element is contended: owner and thieves race for it with
+ * a compare and swap on top_. A thief that loses a race returns NULL, as
+ * if the deque was empty.
+ */
+
+#define CHECK_PTR(ptr)           \
+        do {                     \
+                if (ptr == NULL) \
+                        return;  \
+        } while(0)
+
+struct ws_array {
+
+        long size_;
+        struct ws_array *retired_;
+        void *_Atomic slots_[];
+};
+
+struct ws_deque {
+
+        /* thieves side */
+        _Atomic long top_ __cache_aligned;
+
+        /* owner side */
+        _Atomic long bottom_ __cache_aligned;
+        struct ws_array *_Atomic array_;
+
+        ebr_t ebr_;
+};
+
+static struct ws_array *alloc_array(long size) {
+
+        struct ws_array *a;
+
+        a = (struct ws_array *)malloc(sizeof(struct ws_array) + size * sizeof(void *));
+        if (a == NULL)
+                return NULL;
+        a->size_ = size;
+        a->retired_ = NULL;
+        return a;
+}
+
+/* copy [top, bottom) into an array twice as large, NULL if out of memory */
+static struct ws_array *grow(ws_deque_t d, struct ws_array *a, long top, long bottom) {
+
+        struct ws_array *b = alloc_array(a->size_ * 2);
+        long i;
+        void *elem;
+
+        if (b == NULL)
+                return NULL;
+
+        for (i = top; i < bottom; i++) {
+                elem = atomic_load_explicit(&a->slots_[i & (a->size_ - 1)], memory_order_relaxed);
+                atomic_store_explicit(&b->slots_[i & (b->size_ - 1)], elem, memory_order_relaxed);
+        }
+
+        atomic_store_explicit(&d->array_, b, memory_order_release);
+
+        /* thieves may still read a */
+        if (d->ebr_ != NULL)
+                Ebr_retire(d->ebr_, a, free);
+        else
+                b->retired_ = a;
+        return b;
+}
+
+void Ws_deque_init(ws_deque_t *d, int capacity, ebr_t ebr) {
+
+        struct ws_array *a;
+        long size = 2;
+        void *ptr;
+
+        while (size < capacity)
+                size <<= 1;
+
+        if (posix_memalign(&ptr, CACHE_LINE_SIZE, sizeof(struct ws_deque))) {
+                *d = NULL;
+                return;
+        }
+        *d = (struct ws_deque *)ptr;
+
+        a = alloc_array(size);
+        if (a == NULL) {
+                free(*d);
+                *d = NULL;
+                return;
+        }
+
+        atomic_init(&(*d)->top_, 0);
+        atomic_init(&(*d)->bottom_, 0);
+        atomic_init(&(*d)->array_, a);
+        (*d)->ebr_ = ebr;
+}
+
+void Ws_deque_fini(ws_deque_t *d) {
+
+        struct ws_array *a, *next;
+
+        CHECK_PTR(*d);
+
+        for (a = atomic_load_explicit(&(*d)->array_, memory_order_relaxed); a != NULL; a = next) {
+                next = a->retired_;
+                free(a);
+        }
+
+        free(*d);
+        *d = NULL;
+}
+
+bool Ws_deque_push(ws_deque_t d, void *elem) {
+
+        struct ws_array *a;
+        long bottom, top;
+
+        if (d == NULL)
+                return false;
+
+        bottom = atomic_load_explicit(&d->bottom_, memory_order_relaxed);
+        top = atomic_load_explicit(&d->top_, memory_order_acquire);
+        a = atomic_load_explicit(&d->array_, memory_order_relaxed);
+
+        /* full, and no memory to grow: the deque is left unchanged */
+        if (bottom - top > a->size_ - 1) {
+                a = grow(d, a, top, bottom);
+                if (a == NULL)
+                        return false;
+        }
+
+        atomic_store_explicit(&a->slots_[bottom & (a->size_ - 1)], elem, memory_order_relaxed);
+
+        /* publish the slot to thieves */
+        atomic_store_explicit(&d->bottom_, bottom + 1, memory_order_release);
+        return true;
+}
+
+void *Ws_deque_pop(ws_deque_t d) {
+
+        struct ws_array *a;
+        long bottom, top;
+        void *elem;
+
+        if (d == NULL)
+                return NULL;
+
+        /* reserve the bottom element */
+        bottom = atomic_load_explicit(&d->bottom_, memory_order_relaxed) - 1;
+        a = atomic_load_explicit(&d->array_, memory_order_relaxed);
+        atomic_store_explicit(&d->bottom_, bottom, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        top = atomic_load_explicit(&d->top_, memory_order_relaxed);
+
+        /* empty */
+        if (top > bottom) {
+                atomic_store_explicit(&d->bottom_, bottom + 1, memory_order_relaxed);
+                return NULL;
+        }
+
+        elem = atomic_load_explicit(&a->slots_[bottom & (a->size_ - 1)], memory_order_relaxed);
+
+        /* last element: race the thieves for it */
+        if (top == bottom) {
+                if (!atomic_compare_exchange_strong_explicit(&d->top_, &top, top + 1,
+                                                             memory_order_seq_cst,
+                                                             memory_order_relaxed))
+                        elem = NULL;
+                atomic_store_explicit(&d->bottom_, bottom + 1, memory_order_relaxed);
+        }
+
+        return elem;
+}
+
+void *Ws_deque_steal(ws_deque_t d) {
+
+        struct ws_array *a;
+        long bottom, top;
+        void *elem;
+
+        if (d == NULL)
+                return NULL;
+
+        top = atomic_load_explicit(&d->top_, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        bottom = atomic_load_explicit(&d->bottom_, memory_order_acquire);
+
+        /* empty */
+        if (top >= bottom)
+                return NULL;
+
+        if (d->ebr_ != NULL)
+                Ebr_enter(d->ebr_);
+        a = atomic_load_explicit(&d->array_, memory_order_acquire);
+        elem = atomic_load_explicit(&a->slots_[top & (a->size_ - 1)], memory_order_relaxed);
+        if (d->ebr_ != NULL)
+                Ebr_exit(d->ebr_);
+
+        /* lost the race with the owner or another thief */
+        if (!atomic_compare_exchange_strong_explicit(&d->top_, &top, top + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+                return NULL;
+
+        return elem;
+}
+
+int Ws_deque_size(ws_deque_t d) {
+
+        long bottom = atomic_load_explicit(&d->bottom_, memory_order_relaxed);
+        long top = atomic_load_explicit(&d->top_, memory_order_relaxed);
+
+        return (bottom > top) ? (int)(bottom - top) : 0;
+}
+
+bool Ws_deque_empty(ws_deque_t d) {
+
+        return Ws_deque_size(d) == 0;
+}
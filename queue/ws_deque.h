@@ -0,0 +1,17 @@
+#ifndef __WS_DEQUE_H__
+#define __WS_DEQUE_H__
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "smr.h"
+
+typedef struct ws_deque *ws_deque_t;
+
+void Ws_deque_init(ws_deque_t *, int, ebr_t);
+void Ws_deque_fini(ws_deque_t *);
+bool Ws_deque_push(ws_deque_t, void *);
+void *Ws_deque_pop(ws_deque_t);
+void *Ws_deque_steal(ws_deque_t);
+int  Ws_deque_size(ws_deque_t);
+bool Ws_deque_empty(ws_deque_t);
+#endif
@@ -0,0 +1,799 @@
+/*
+ * Benchmark for the tree containers against std::map and std::unordered_map
+ *
+ * For every container, key distribution and size the benchmark runs four
+ * timed phases on the same container instance:
+ *
+ *   insert : n distinct keys inserted in distribution order
+ *   search : n lookups of inserted keys drawn from the distribution
+ *   mixed  : n operations, 50% search, 25% insert, 25% delete
+ *   delete : every key still present deleted in distribution order
+ *
+ * Distributions:
+ *
+ *   seq         : ascending keys
+ *   random      : uniformly shuffled keys
+ *   zipf        : shuffled inserts, lookups Zipf(s = 0.99) distributed
+ *   adversarial : keys taken alternately from both ends towards the middle
+ *
+ * Each phase reports throughput, p50/p99 latency of sampled operations,
+ * heap bytes per element after the insert phase (glibc mallinfo2) and,
+ * where perf_event_open is permitted, cycles, instructions, cache misses
+ * and branch misses per operation. Results are printed as a table or, with
+ * --json/--csv, in a machine-readable form that can be diffed across
+ * versions.
+ *
+ * BST is unbalanced and recursive: it is skipped for seq and adversarial
+ * keys above BST_DEGENERATE_MAX elements, where it degenerates into a list.
+ *
+ * With --pq the containers are priority queues instead: RBT used through
+ * findMinKey + deleteKey against the 4-ary and 8-ary DaryHeap, with the
+ * phases
+ *
+ *   insert   : n keys inserted one by one in distribution order
+ *   decrease : n key decreases of elements picked at random (RBT: delete
+ *              and insert again)
+ *   hold     : n times pop the minimum and insert a larger key
+ *   popmin   : pop the minimum until empty
+ *   heapify  : heaps only, the same n keys built in one batch
+ *   popn     : heaps only, pop until empty in batches of POP_BATCH
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "bst.hpp"
+#include "rbt.hpp"
+#include "heap.hpp"
+
+#define BST_DEGENERATE_MAX (16 * 1024)
+#define LATENCY_SAMPLE     64 /* time one operation every LATENCY_SAMPLE */
+#define POP_BATCH          64 /* elements per popN in the popn phase */
+
+typedef uint64_t key_t_;
+
+/* xorshift64* generator, cheap enough not to dominate the timed loops */
+class Random {
+        private:
+                uint64_t state_;
+
+        public:
+                Random(uint64_t seed) {
+                        state_ = seed ? seed : 0x9E3779B97F4A7C15ULL;
+                }
+
+                uint64_t next() {
+                        state_ ^= state_ >> 12;
+                        state_ ^= state_ << 25;
+                        state_ ^= state_ >> 27;
+                        return state_ * 0x2545F4914F6CDD1DULL;
+                }
+
+                /* uniform in [0, n) */
+                uint64_t below(uint64_t n) {
+                        return next() % n;
+                }
+
+                /* uniform in [0, 1) */
+                double uniform() {
+                        return (next() >> 11) * (1.0 / 9007199254740992.0);
+                }
+};
+
+/* Zipf sampler by rejection-inversion (Hormann, Derflinger), O(1) per sample */
+class Zipf {
+        private:
+                double s_, hx1_, hn_, threshold_;
+                uint64_t n_;
+
+                static double helper1(double x) {
+                        return (std::fabs(x) > 1e-8) ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+                }
+
+                static double helper2(double x) {
+                        return (std::fabs(x) > 1e-8) ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+                }
+
+                double h(double x) {
+                        return std::exp(-s_ * std::log(x));
+                }
+
+                double hIntegral(double x) {
+                        double lx = std::log(x);
+                        return helper2((1 - s_) * lx) * lx;
+                }
+
+                double hIntegralInverse(double x) {
+                        double t = x * (1 - s_);
+                        if (t < -1)
+                                t = -1;
+                        return std::exp(helper1(t) * x);
+                }
+
+        public:
+                Zipf(uint64_t n, double s) {
+                        n_ = n;
+                        s_ = s;
+                        hx1_ = hIntegral(1.5) - 1;
+                        hn_ = hIntegral(n + 0.5);
+                        threshold_ = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+                }
+
+                /* rank in [0, n) */
+                uint64_t next(Random & rng) {
+                        for (;;) {
+                                double u = hn_ + rng.uniform() * (hx1_ - hn_);
+                                double x = hIntegralInverse(u);
+                                uint64_t k = (uint64_t)(x + 0.5);
+
+                                if (k < 1)
+                                        k = 1;
+                                else if (k > n_)
+                                        k = n_;
+                                if ((k - x <= threshold_) || (u >= hIntegral(k + 0.5) - h(k)))
+                                        return k - 1;
+                        }
+                }
+};
+
+/* hardware counters of the calling thread, if the kernel lets us */
+class PerfCounters {
+        private:
+                enum { CYCLES = 0, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, COUNTERS };
+                int fd_[COUNTERS];
+                uint64_t value_[COUNTERS];
+
+                static int open(uint64_t config, int group) {
+                        struct perf_event_attr attr;
+
+                        memset(&attr, 0, sizeof(attr));
+                        attr.size = sizeof(attr);
+                        attr.type = PERF_TYPE_HARDWARE;
+                        attr.config = config;
+                        attr.disabled = (group == -1);
+                        attr.exclude_kernel = 1;
+                        attr.exclude_hv = 1;
+                        attr.read_format = PERF_FORMAT_GROUP;
+                        return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+                }
+
+        public:
+                PerfCounters() {
+                        static const uint64_t config[COUNTERS] = {
+                                PERF_COUNT_HW_CPU_CYCLES,
+                                PERF_COUNT_HW_INSTRUCTIONS,
+                                PERF_COUNT_HW_CACHE_MISSES,
+                                PERF_COUNT_HW_BRANCH_MISSES,
+                        };
+
+                        for (int i = 0; i < COUNTERS; i++) {
+                                fd_[i] = -1;
+                                value_[i] = 0;
+                        }
+
+                        for (int i = 0; i < COUNTERS; i++) {
+                                fd_[i] = open(config[i], (i == 0) ? -1 : fd_[0]);
+                                if (fd_[i] < 0) {
+                                        close();
+                                        break;
+                                }
+                        }
+                }
+
+                ~PerfCounters() {
+                        close();
+                }
+
+                bool available() const {
+                        return fd_[0] >= 0;
+                }
+
+                void start() {
+                        if (!available())
+                                return;
+                        ioctl(fd_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                        ioctl(fd_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+                }
+
+                void stop() {
+                        uint64_t buf[1 + COUNTERS];
+
+                        if (!available())
+                                return;
+                        ioctl(fd_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+                        if (read(fd_[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+                                return;
+                        for (int i = 0; i < COUNTERS; i++)
+                                value_[i] = buf[1 + i];
+                }
+
+                uint64_t cycles() const { return value_[CYCLES]; }
+                uint64_t instructions() const { return value_[INSTRUCTIONS]; }
+                uint64_t cacheMisses() const { return value_[CACHE_MISSES]; }
+                uint64_t branchMisses() const { return value_[BRANCH_MISSES]; }
+
+        private:
+                void close() {
+                        for (int i = 0; i < COUNTERS; i++) {
+                                if (fd_[i] >= 0)
+                                        ::close(fd_[i]);
+                                fd_[i] = -1;
+                        }
+                }
+};
+
+static uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 mi = mallinfo2();
+
+        /* large blocks, like big vector buffers, are mmapped */
+        return mi.uordblks + mi.hblkhd;
+#else
+        return 0;
+#endif
+}
+
+/* container adapters */
+template <typename T> struct Adapter;
+
+template <typename K, typename V> struct Adapter< trees::BST<K,V> > {
+        static void insert(trees::BST<K,V> & c, K k, V v) { c.insertKey(k, v); }
+        static bool search(trees::BST<K,V> & c, K k) {
+                trees::Node<K,V> * n = c.searchKey(k);
+                return !c.isNil(n) && (n->getKey() == k);
+        }
+        static void erase(trees::BST<K,V> & c, K k) { c.deleteKey(k); }
+};
+
+template <typename K, typename V> struct Adapter< trees::RBT<K,V> > {
+        static void insert(trees::RBT<K,V> & c, K k, V v) { c.insertKey(k, v); }
+        static bool search(trees::RBT<K,V> & c, K k) {
+                trees::Node<K,V> * n = c.searchKey(k);
+                return !c.isNil(n) && (n->getKey() == k);
+        }
+        static void erase(trees::RBT<K,V> & c, K k) { c.deleteKey(k); }
+};
+
+template <typename K, typename V> struct Adapter< std::map<K,V> > {
+        static void insert(std::map<K,V> & c, K k, V v) { c[k] = v; }
+        static bool search(std::map<K,V> & c, K k) { return c.find(k) != c.end(); }
+        static void erase(std::map<K,V> & c, K k) { c.erase(k); }
+};
+
+template <typename K, typename V> struct Adapter< std::unordered_map<K,V> > {
+        static void insert(std::unordered_map<K,V> & c, K k, V v) { c[k] = v; }
+        static bool search(std::unordered_map<K,V> & c, K k) { return c.find(k) != c.end(); }
+        static void erase(std::unordered_map<K,V> & c, K k) { c.erase(k); }
+};
+
+struct Options {
+        std::vector<size_t> sizes;
+        std::vector<std::string> containers;
+        std::vector<std::string> dists;
+        std::string format;
+        size_t cache;
+        bool lazy;
+        bool pq;
+        uint64_t seed;
+};
+
+struct Result {
+        std::string container, dist, phase;
+        size_t size, ops;
+        double seconds, p50, p99, bytesPerElem;
+        bool perf;
+        uint64_t cycles, instructions, cacheMisses, branchMisses;
+        std::string treeStats;
+};
+
+/* keys of a workload and the order they are inserted, searched and deleted in */
+struct Workload {
+        std::vector<key_t_> keys;     /* insertion order */
+        std::vector<key_t_> lookups;  /* search phase */
+        std::vector<key_t_> ops;      /* mixed phase keys */
+        std::vector<uint8_t> kinds;   /* mixed phase: 0,1 search, 2 insert, 3 delete */
+};
+
+static void buildWorkload(Workload & w, const std::string & dist, size_t n, uint64_t seed) {
+        Random rng(seed);
+        std::vector<key_t_> sorted(n);
+
+        /* spread keys so that hashing and comparisons see realistic values */
+        for (size_t i = 0; i < n; i++)
+                sorted[i] = (key_t_)i * 2654435761ULL;
+
+        w.keys.resize(n);
+        if (dist == "seq") {
+                w.keys = sorted;
+        }
+        else if (dist == "adversarial") {
+                for (size_t i = 0, lo = 0, hi = n; i < n; i++)
+                        w.keys[i] = (i & 1) ? sorted[--hi] : sorted[lo++];
+        }
+        else {
+                w.keys = sorted;
+                for (size_t i = n - 1; i > 0; i--)
+                        std::swap(w.keys[i], w.keys[rng.below(i + 1)]);
+        }
+
+        w.lookups.resize(n);
+        w.ops.resize(n);
+        w.kinds.resize(n);
+        if (dist == "zipf") {
+                Zipf zipf(n, 0.99);
+                for (size_t i = 0; i < n; i++) {
+                        w.lookups[i] = w.keys[zipf.next(rng)];
+                        w.ops[i] = w.keys[zipf.next(rng)];
+                }
+        }
+        else if (dist == "random") {
+                for (size_t i = 0; i < n; i++) {
+                        w.lookups[i] = w.keys[rng.below(n)];
+                        w.ops[i] = w.keys[rng.below(n)];
+                }
+        }
+        else {
+                /* seq and adversarial replay the insertion order */
+                w.lookups = w.keys;
+                w.ops = w.keys;
+        }
+        for (size_t i = 0; i < n; i++)
+                w.kinds[i] = rng.below(4);
+}
+
+template <typename C> static std::string treeStats(C &) {
+        return "";
+}
+
+template <typename K, typename V> static std::string treeStats(trees::RBT<K,V> & c) {
+        std::ostringstream os;
+#ifdef TREES_STATS
+        c.stats().toJson(os);
+        c.resetStats();
+#else
+        (void)c;
+#endif
+        return os.str();
+}
+
+template <typename K, typename V> static std::string treeStats(trees::BST<K,V> & c) {
+        std::ostringstream os;
+#ifdef TREES_STATS
+        c.stats().toJson(os);
+        c.resetStats();
+#else
+        (void)c;
+#endif
+        return os.str();
+}
+
+/* time op over keys, sampling single operation latency */
+template <typename OP> static void runPhase(Result & r, size_t n, OP op) {
+        std::vector<uint64_t> samples;
+        PerfCounters perf;
+        uint64_t start, t;
+
+        samples.reserve(n / LATENCY_SAMPLE + 1);
+        perf.start();
+        start = nowNs();
+        for (size_t i = 0; i < n; i++) {
+                if ((i % LATENCY_SAMPLE) == 0) {
+                        t = nowNs();
+                        op(i);
+                        samples.push_back(nowNs() - t);
+                }
+                else
+                        op(i);
+        }
+        r.seconds = (nowNs() - start) * 1e-9;
+        perf.stop();
+
+        r.ops = n;
+        std::sort(samples.begin(), samples.end());
+        r.p50 = samples.empty() ? 0 : samples[samples.size() / 2];
+        r.p99 = samples.empty() ? 0 : samples[(samples.size() * 99) / 100];
+        r.perf = perf.available();
+        r.cycles = perf.cycles();
+        r.instructions = perf.instructions();
+        r.cacheMisses = perf.cacheMisses();
+        r.branchMisses = perf.branchMisses();
+}
+
+template <typename C> static void benchmark(C & c, const std::string & name, const std::string & dist,
+                                            const Workload & w, std::vector<Result> & results) {
+        typedef Adapter<C> A;
+        size_t n = w.keys.size(), found = 0, heap;
+        Result r;
+
+        r.container = name;
+        r.dist = dist;
+        r.size = n;
+        r.bytesPerElem = 0;
+
+        /* insert */
+        heap = heapBytes();
+        r.phase = "insert";
+        runPhase(r, n, [&](size_t i) { A::insert(c, w.keys[i], i); });
+        r.bytesPerElem = (double)(heapBytes() - heap) / n;
+        r.treeStats = treeStats(c);
+        results.push_back(r);
+
+        /* search */
+        r.phase = "search";
+        runPhase(r, n, [&](size_t i) { found += A::search(c, w.lookups[i]); });
+        r.treeStats = treeStats(c);
+        results.push_back(r);
+
+        /* mixed */
+        r.phase = "mixed";
+        runPhase(r, n, [&](size_t i) {
+                switch (w.kinds[i]) {
+                case 2:
+                        A::insert(c, w.ops[i], i);
+                        break;
+                case 3:
+                        A::erase(c, w.ops[i]);
+                        break;
+                default:
+                        found += A::search(c, w.ops[i]);
+                }
+        });
+        r.treeStats = treeStats(c);
+        results.push_back(r);
+
+        /* delete */
+        r.phase = "delete";
+        runPhase(r, n, [&](size_t i) { A::erase(c, w.keys[i]); });
+        r.treeStats = treeStats(c);
+        results.push_back(r);
+
+        /* keep lookups observable */
+        if (found == (size_t)-1)
+                std::cerr << found << std::endl;
+}
+
+/* priority queue adapters: insert returns what decrease needs to find the element */
+template <typename T> struct PqAdapter;
+
+template <typename K, typename V> struct PqAdapter< trees::RBT<K,V> > {
+        typedef K Handle;
+        static Handle insert(trees::RBT<K,V> & c, K k, V v) { c.insertKey(k, v); return k; }
+        static K minKey(trees::RBT<K,V> & c) { return c.findMinKey()->getKey(); }
+        static void popMin(trees::RBT<K,V> & c) { c.deleteKey(c.findMinKey()->getKey()); }
+        static size_t size(trees::RBT<K,V> & c) { return c.size(); }
+        static K key(trees::RBT<K,V> &, Handle h) { return h; }
+        static Handle decrease(trees::RBT<K,V> & c, Handle h, K k) {
+                trees::Node<K,V> * node = c.searchKey(h);
+                V v;
+
+                /* keys are unique: skip elements gone and decreases that would merge two */
+                if (c.isNil(node) || !c.isNil(c.searchKey(k)))
+                        return h;
+                v = node->getValue();
+                c.deleteKey(h);
+                c.insertKey(k, v);
+                return k;
+        }
+};
+
+template <typename K, typename V, unsigned D> struct PqAdapter< trees::DaryHeap<K,V,D> > {
+        typedef typename trees::DaryHeap<K,V,D>::Handle Handle;
+        static Handle insert(trees::DaryHeap<K,V,D> & c, K k, V v) { return c.insertKey(k, v); }
+        static size_t size(trees::DaryHeap<K,V,D> & c) { return c.size(); }
+        static K minKey(trees::DaryHeap<K,V,D> & c) { return c.minKey(); }
+        static void popMin(trees::DaryHeap<K,V,D> & c) { c.popMin(); }
+        static K key(trees::DaryHeap<K,V,D> & c, Handle h) { return c.key(h); }
+        static Handle decrease(trees::DaryHeap<K,V,D> & c, Handle h, K k) {
+                c.decreaseKey(h, k);
+                return h;
+        }
+};
+
+/* phases shared by the RBT and the heaps */
+template <typename C> static void benchmarkPqCommon(C & c, Result & r, const Workload & w,
+                                                    std::vector<Result> & results) {
+        typedef PqAdapter<C> A;
+        size_t n = w.keys.size();
+        std::vector<typename A::Handle> handles(n);
+        Random rng(n);
+        uint64_t sum = 0;
+        size_t heap;
+
+        /* insert */
+        heap = heapBytes();
+        r.phase = "insert";
+        runPhase(r, n, [&](size_t i) { handles[i] = A::insert(c, w.keys[i], i); });
+        r.bytesPerElem = (double)(heapBytes() - heap) / n;
+        results.push_back(r);
+
+        /* decrease */
+        r.phase = "decrease";
+        runPhase(r, n, [&](size_t i) {
+                size_t j = rng.below(n);
+                key_t_ k = A::key(c, handles[j]);
+
+                (void)i;
+                if (k > 0)
+                        handles[j] = A::decrease(c, handles[j], k - 1);
+        });
+        results.push_back(r);
+
+        /* hold: pop the minimum, insert a larger key */
+        r.phase = "hold";
+        runPhase(r, n, [&](size_t i) {
+                key_t_ k;
+
+                if (A::size(c) == 0)
+                        return;
+                k = A::minKey(c);
+                A::popMin(c);
+                A::insert(c, k + (w.keys[i] | 1), i);
+        });
+        results.push_back(r);
+
+        /* popmin: the RBT may hold less than n, duplicate keys collapse */
+        r.phase = "popmin";
+        runPhase(r, A::size(c), [&](size_t) {
+                sum += A::minKey(c);
+                A::popMin(c);
+        });
+        results.push_back(r);
+
+        if (sum == 1)
+                std::cerr << sum << std::endl;
+}
+
+template <typename K, typename V> static void benchmarkPq(trees::RBT<K,V> & c, const std::string & name,
+                                                          const std::string & dist, const Workload & w,
+                                                          std::vector<Result> & results) {
+        Result r;
+
+        r.container = name;
+        r.dist = dist;
+        r.size = w.keys.size();
+        r.bytesPerElem = 0;
+        benchmarkPqCommon(c, r, w, results);
+}
+
+template <typename K, typename V, unsigned D> static void benchmarkPq(trees::DaryHeap<K,V,D> & c,
+                                                                      const std::string & name,
+                                                                      const std::string & dist,
+                                                                      const Workload & w,
+                                                                      std::vector<Result> & results) {
+        size_t n = w.keys.size();
+        std::vector<std::pair<K,V> > batch(n), out;
+        Result r;
+
+        r.container = name;
+        r.dist = dist;
+        r.size = n;
+        r.bytesPerElem = 0;
+        benchmarkPqCommon(c, r, w, results);
+
+        /* heapify: one timed bulk build, no per operation latency */
+        for (size_t i = 0; i < n; i++)
+                batch[i] = std::make_pair(w.keys[i], (V)i);
+        c.clear();
+        r.phase = "heapify";
+        runPhase(r, 1, [&](size_t) { c.insertBatch(batch.begin(), batch.end()); });
+        r.ops = n;
+        r.p50 = r.p99 = 0;
+        results.push_back(r);
+
+        /* popn */
+        out.reserve(POP_BATCH);
+        r.phase = "popn";
+        runPhase(r, (n + POP_BATCH - 1) / POP_BATCH, [&](size_t) {
+                out.clear();
+                c.popN(POP_BATCH, out);
+        });
+        r.ops = n;
+        results.push_back(r);
+}
+
+static void print(const std::vector<Result> & results, const std::string & format) {
+        if (format == "json") {
+                std::cout << "[" << std::endl;
+                for (size_t i = 0; i < results.size(); i++) {
+                        const Result & r = results[i];
+                        std::cout << "  {\"container\": \"" << r.container << "\""
+                                  << ", \"dist\": \"" << r.dist << "\""
+                                  << ", \"phase\": \"" << r.phase << "\""
+                                  << ", \"size\": " << r.size
+                                  << ", \"ops_per_sec\": " << (uint64_t)(r.ops / r.seconds)
+                                  << ", \"p50_ns\": " << r.p50
+                                  << ", \"p99_ns\": " << r.p99
+                                  << ", \"bytes_per_elem\": " << r.bytesPerElem;
+                        if (r.perf)
+                                std::cout << ", \"cycles_per_op\": " << (double)r.cycles / r.ops
+                                          << ", \"instructions_per_op\": " << (double)r.instructions / r.ops
+                                          << ", \"cache_misses_per_op\": " << (double)r.cacheMisses / r.ops
+                                          << ", \"branch_misses_per_op\": " << (double)r.branchMisses / r.ops;
+                        if (!r.treeStats.empty())
+                                std::cout << ", \"tree_stats\": " << r.treeStats;
+                        std::cout << "}" << ((i + 1 < results.size()) ? "," : "") << std::endl;
+                }
+                std::cout << "]" << std::endl;
+                return;
+        }
+
+        if (format == "csv") {
+                std::cout << "container,dist,phase,size,ops_per_sec,p50_ns,p99_ns,bytes_per_elem,"
+                          << "cycles_per_op,instructions_per_op,cache_misses_per_op,branch_misses_per_op" << std::endl;
+                for (size_t i = 0; i < results.size(); i++) {
+                        const Result & r = results[i];
+                        std::cout << r.container << "," << r.dist << "," << r.phase << "," << r.size << ","
+                                  << (uint64_t)(r.ops / r.seconds) << "," << r.p50 << "," << r.p99 << ","
+                                  << r.bytesPerElem;
+                        if (r.perf)
+                                std::cout << "," << (double)r.cycles / r.ops << "," << (double)r.instructions / r.ops
+                                          << "," << (double)r.cacheMisses / r.ops << "," << (double)r.branchMisses / r.ops;
+                        else
+                                std::cout << ",,,,";
+                        std::cout << std::endl;
+                }
+                return;
+        }
+
+        printf("%-8s %-12s %-8s %10s %14s %8s %8s %10s %10s %10s\n", "tree", "dist", "phase", "size",
+               "ops/s", "p50 ns", "p99 ns", "B/elem", "cyc/op", "miss/op");
+        for (size_t i = 0; i < results.size(); i++) {
+                const Result & r = results[i];
+                printf("%-8s %-12s %-8s %10zu %14.0f %8.0f %8.0f %10.1f", r.container.c_str(), r.dist.c_str(),
+                       r.phase.c_str(), r.size, r.ops / r.seconds, r.p50, r.p99, r.bytesPerElem);
+                if (r.perf)
+                        printf(" %10.1f %10.2f\n", (double)r.cycles / r.ops, (double)r.cacheMisses / r.ops);
+                else
+                        printf(" %10s %10s\n", "-", "-");
+        }
+}
+
+static std::vector<std::string> split(const char * arg) {
+        std::vector<std::string> list;
+        std::stringstream ss(arg);
+        std::string item;
+
+        while (std::getline(ss, item, ','))
+                list.push_back(item);
+        return list;
+}
+
+static void usage(const char * prog) {
+        fprintf(stderr,
+                "usage: %s [options]\n"
+                "  --sizes N,...          element counts (default 1000,10000,100000,1000000)\n"
+                "  --containers NAME,...  bst,rbt,map,umap (default all), with --pq rbt,heap4,heap8\n"
+                "  --dists NAME,...       seq,random,zipf,adversarial (default all)\n"
+                "  --cache SLOTS          enable the RBT hot key cache\n"
+                "  --lazy                 enable RBT lazy deletion\n"
+                "  --pq                   priority queue benchmark, containers rbt,heap4,heap8\n"
+                "  --seed N               workload seed\n"
+                "  --json | --csv         machine-readable output\n", prog);
+        exit(1);
+}
+
+int main(int argc, char *argv[]) {
+        Options opt;
+        std::vector<Result> results;
+        bool containersSet = false;
+
+        opt.sizes = {1000, 10000, 100000, 1000000};
+        opt.containers = {"bst", "rbt", "map", "umap"};
+        opt.dists = {"seq", "random", "zipf", "adversarial"};
+        opt.format = "text";
+        opt.cache = 0;
+        opt.lazy = false;
+        opt.pq = false;
+        opt.seed = 42;
+
+        for (int i = 1; i < argc; i++) {
+                std::string arg = argv[i];
+
+                if ((arg == "--sizes") && (i + 1 < argc)) {
+                        opt.sizes.clear();
+                        for (const std::string & s : split(argv[++i]))
+                                opt.sizes.push_back(strtoull(s.c_str(), NULL, 10));
+                }
+                else if ((arg == "--containers") && (i + 1 < argc)) {
+                        opt.containers = split(argv[++i]);
+                        containersSet = true;
+                }
+                else if ((arg == "--dists") && (i + 1 < argc))
+                        opt.dists = split(argv[++i]);
+                else if ((arg == "--cache") && (i + 1 < argc))
+                        opt.cache = strtoull(argv[++i], NULL, 10);
+                else if ((arg == "--seed") && (i + 1 < argc))
+                        opt.seed = strtoull(argv[++i], NULL, 10);
+                else if (arg == "--lazy")
+                        opt.lazy = true;
+                else if (arg == "--pq")
+                        opt.pq = true;
+                else if (arg == "--json")
+                        opt.format = "json";
+                else if (arg == "--csv")
+                        opt.format = "csv";
+                else
+                        usage(argv[0]);
+        }
+
+        /* priority queues only make sense for these */
+        if (opt.pq && !containersSet)
+                opt.containers = {"rbt", "heap4", "heap8"};
+
+        for (size_t n : opt.sizes) {
+                if (n == 0)
+                        continue;
+                for (const std::string & dist : opt.dists) {
+                        Workload w;
+
+                        buildWorkload(w, dist, n, opt.seed);
+                        for (const std::string & name : opt.containers) {
+                                if (opt.pq) {
+                                        if (name == "rbt") {
+                                                trees::RBT<key_t_,uint64_t> c;
+                                                benchmarkPq(c, name, dist, w, results);
+                                        }
+                                        else if (name == "heap4") {
+                                                trees::DaryHeap<key_t_,uint64_t,4> c;
+                                                benchmarkPq(c, name, dist, w, results);
+                                        }
+                                        else if (name == "heap8") {
+                                                trees::DaryHeap<key_t_,uint64_t,8> c;
+                                                benchmarkPq(c, name, dist, w, results);
+                                        }
+                                        else
+                                                usage(argv[0]);
+                                }
+                                else if (name == "bst") {
+                                        if ((dist == "seq" || dist == "adversarial") && (n > BST_DEGENERATE_MAX)) {
+                                                fprintf(stderr, "skipping bst/%s/%zu: degenerate tree\n", dist.c_str(), n);
+                                                continue;
+                                        }
+                                        trees::BST<key_t_,uint64_t> c;
+                                        benchmark(c, name, dist, w, results);
+                                }
+                                else if (name == "rbt") {
+                                        trees::RBT<key_t_,uint64_t> c;
+                                        c.setCache(opt.cache);
+                                        c.setLazyDelete(opt.lazy);
+                                        benchmark(c, name, dist, w, results);
+                                }
+                                else if (name == "map") {
+                                        std::map<key_t_,uint64_t> c;
+                                        benchmark(c, name, dist, w, results);
+                                }
+                                else if (name == "umap") {
+                                        std::unordered_map<key_t_,uint64_t> c;
+                                        benchmark(c, name, dist, w, results);
+                                }
+                                else
+                                        usage(argv[0]);
+                        }
+                }
+        }
+
+        print(results, opt.format);
+        return 0;
+}
@@ -2,7 +2,9 @@
 #define __BST_H__
 
 #include <iostream>
+#include <vector>
 #include "node.hpp"
+#include "stats.hpp"
 
 namespace trees {
 
@@ -12,12 +14,17 @@ namespace trees {
                 protected:
                         Node<KEY,VALUE> *root_;
                         Node<KEY,VALUE> *leaf_;
+                        size_t size_;
+#ifdef TREES_STATS
+                        TreeStats stats_;
+#endif
 
                 public:
                         /* default constructor */
                         BST() {
                                 root_ = NULL;
                                 leaf_ = NULL;
+                                size_ = 0;
                         }
 
                         /* destructor */
@@ -52,6 +59,7 @@ namespace trees {
 
                                 /* deleting the root */
                                 if (parent == NULL) {
+                                        root_ = NULL;
                                         goto delete_node;
                                 }
 
@@ -72,8 +80,16 @@ namespace trees {
                                         else
                                                 parent->right_ = leaf_;
                                 }
+
+                                /* min/max node has at most one child, relink it */
+                                if (child->left_ != leaf_)
+                                        child->left_->parent_ = parent;
+                                else if (child->right_ != leaf_)
+                                        child->right_->parent_ = parent;
 delete_node:
                                 deleteNode(child);
+                                size_--;
+                                TREES_STAT(stats_.frees++);
                         }
 
                         /* return node with key k */
@@ -81,6 +97,78 @@ delete_node:
                                 return searchKeyInternal(k, root_);
                         }
 
+                        /* true for NULL and the sentinel leaf, what searches return on a miss */
+                        bool isNil(const Node<KEY,VALUE> * node) const {
+                                return (node == NULL) || (node == leaf_);
+                        }
+
+                        /* number of nodes in the tree */
+                        size_t size() {
+                                return size_;
+                        }
+
+                        /* operation counters, zero unless built with TREES_STATS */
+                        TreeStats stats() {
+#ifdef TREES_STATS
+                                return stats_;
+#else
+                                return TreeStats();
+#endif
+                        }
+
+                        /* reset operation counters */
+                        void resetStats() {
+                                TREES_STAT(stats_ = TreeStats());
+                        }
+
+                        /* walk the tree and report node count, memory and depth histograms */
+                        TreeReport report() {
+                                TreeReport r;
+                                std::vector<Node<KEY,VALUE> *> stack;
+                                std::vector<size_t> depth, black;
+                                Node<KEY,VALUE> * node;
+                                size_t d, b;
+
+                                if (root_ != NULL) {
+                                        stack.push_back(root_);
+                                        depth.push_back(0);
+                                        black.push_back(0);
+                                }
+
+                                while (!stack.empty()) {
+                                        node = stack.back(); stack.pop_back();
+                                        d = depth.back(); depth.pop_back();
+                                        b = black.back(); black.pop_back();
+
+                                        /* reached a nil child */
+                                        if ((node == NULL) || (node == leaf_)) {
+                                                if (r.blackHeight.size() <= b)
+                                                        r.blackHeight.resize(b + 1);
+                                                r.blackHeight[b]++;
+                                                continue;
+                                        }
+
+                                        r.nodes++;
+                                        if (node->tombstone_)
+                                                r.tombstones++;
+                                        if (r.depth.size() <= d)
+                                                r.depth.resize(d + 1);
+                                        r.depth[d]++;
+
+                                        if (node->colour_ == BLACK)
+                                                b++;
+                                        stack.push_back(node->left_);
+                                        depth.push_back(d + 1);
+                                        black.push_back(b);
+                                        stack.push_back(node->right_);
+                                        depth.push_back(d + 1);
+                                        black.push_back(b);
+                                }
+
+                                r.bytes = (r.nodes + (leaf_ ? 1 : 0)) * sizeof(Node<KEY,VALUE>);
+                                return r;
+                        }
+
                         /* find the maximum */
                         Node<KEY,VALUE> * findMaxKey() {
                                 Node<KEY,VALUE> * max;
@@ -129,27 +217,35 @@ delete_node:
                                         (*node)->parent_ = parent;
                                         (*node)->left_ = leaf_;
                                         (*node)->right_ = leaf_;
+                                        size_++;
+                                        TREES_STAT(stats_.allocations++);
                                         return;
                                 }
 
+                                TREES_STAT(stats_.insertComparisons++);
                                 if (k < (*node)->key_) {
                                         insertKeyInternal(k, v, &(*node)->left_, *node);
                                 }
                                 else if (k > (*node)->key_) {
+                                        TREES_STAT(stats_.insertComparisons++);
                                         insertKeyInternal(k, v, &(*node)->right_, *node);
                                 }
                                 else {
+                                        TREES_STAT(stats_.insertComparisons++);
+
                                         /* replace existing node */
                                         p = new Node<KEY,VALUE>(k, v);
+                                        TREES_STAT(stats_.allocations++; stats_.frees++);
                                         p->left_  = (*node)->left_;
                                         p->right_ = (*node)->right_;
                                         p->parent_= (*node)->parent_;
                                         p->colour_= (*node)->colour_;
-                                        if (parent->left_ == *node)
-                                                parent->left_ = p;
-                                        else
-                                                parent->right_ = p;
+                                        if (p->left_ != leaf_)
+                                                p->left_->parent_ = p;
+                                        if (p->right_ != leaf_)
+                                                p->right_->parent_ = p;
                                         delete *node;
+                                        *node = p;
                                 }
                         }
 
@@ -184,12 +280,17 @@ delete_node:
                         Node<KEY,VALUE> * searchKeyInternal(const KEY & k, Node<KEY,VALUE> * node) {
                                 Node<KEY,VALUE> * p = node;
 
+                                TREES_STAT(if (node == root_) stats_.searches++);
+
                                 if ((node == NULL) || (node == leaf_))
                                         return leaf_;
 
+                                TREES_STAT(stats_.searchComparisons++);
                                 if (k < p->key_)
                                         return searchKeyInternal(k, p->left_);
-                                else if (k > p->key_)
+
+                                TREES_STAT(stats_.searchComparisons++);
+                                if (k > p->key_)
                                         return searchKeyInternal(k, p->right_);
 
                                 return p;
@@ -0,0 +1,136 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <functional>
+#include "node.hpp"
+
+namespace trees {
+
+        /* counters reported by the node cache */
+        struct CacheStats {
+                size_t hits;          /* lookups served by the cache */
+                size_t misses;        /* lookups that descended the tree and filled a slot */
+                size_t bypasses;      /* lookups for absent keys, never cached */
+                size_t invalidations; /* slots dropped by delete/replace */
+
+                double hitRate() const {
+                        size_t total = hits + misses + bypasses;
+                        return (total > 0) ? (double)hits / total : 0.0;
+                }
+        };
+
+        /*
+         * Direct mapped cache from keys to tree nodes. Slots are selected
+         * by Fibonacci hashing of std::hash<KEY>, so the number of slots
+         * is always a power of two. The tree owning the cache is in charge
+         * of invalidating the slots of nodes it frees or replaces.
+         */
+        template <typename KEY, typename VALUE> class NodeCache {
+
+                private:
+                        Node<KEY,VALUE> **slots_;
+                        size_t size_;
+                        int shift_;
+                        CacheStats stats_;
+
+                public:
+                        /* default constructor: cache disabled */
+                        NodeCache() {
+                                slots_ = NULL;
+                                size_ = 0;
+                                shift_ = 0;
+                                resetStats();
+                        }
+
+                        /* destructor */
+                        ~NodeCache() {
+                                delete [] slots_;
+                        }
+
+                        /* resize the cache to at least n slots, 0 disables it */
+                        void resize(size_t n) {
+                                size_t slots = 1;
+                                int bits = 0;
+
+                                delete [] slots_;
+                                slots_ = NULL;
+                                size_ = 0;
+                                if (n == 0)
+                                        return;
+
+                                while (slots < n) {
+                                        slots <<= 1;
+                                        bits++;
+                                }
+                                shift_ = 64 - bits;
+                                size_ = slots;
+                                slots_ = new Node<KEY,VALUE> *[slots]();
+                        }
+
+                        /* is the cache in use */
+                        bool enabled() const {
+                                return slots_ != NULL;
+                        }
+
+                        /* memory used by the slots */
+                        size_t bytes() const {
+                                return size_ * sizeof(Node<KEY,VALUE> *);
+                        }
+
+                        /* return cached node for key k or NULL */
+                        Node<KEY,VALUE> * lookup(const KEY & k) {
+                                Node<KEY,VALUE> * node = slots_[slot(k)];
+
+                                if ((node != NULL) && !(node->getKey() < k) && !(k < node->getKey())) {
+                                        stats_.hits++;
+                                        return node;
+                                }
+                                return NULL;
+                        }
+
+                        /* fill the slot of key k after a tree lookup */
+                        void store(const KEY & k, Node<KEY,VALUE> * node) {
+                                if (node == NULL) {
+                                        stats_.bypasses++;
+                                        return;
+                                }
+                                stats_.misses++;
+                                slots_[slot(k)] = node;
+                        }
+
+                        /*
+                         * drop the slot of key k if it caches k. A slot left
+                         * holding another key is safe: lookup checks the key,
+                         * and every node the tree frees is invalidated under
+                         * the key it holds when freed
+                         */
+                        void invalidate(const KEY & k) {
+                                Node<KEY,VALUE> ** s = &slots_[slot(k)];
+
+                                if ((*s != NULL) && !((*s)->getKey() < k) && !(k < (*s)->getKey())) {
+                                        *s = NULL;
+                                        stats_.invalidations++;
+                                }
+                        }
+
+                        /* get counters */
+                        CacheStats stats() const {
+                                return stats_;
+                        }
+
+                        /* reset counters */
+                        void resetStats() {
+                                stats_.hits = 0;
+                                stats_.misses = 0;
+                                stats_.bypasses = 0;
+                                stats_.invalidations = 0;
+                        }
+
+                private:
+                        size_t slot(const KEY & k) const {
+                                unsigned long long h = std::hash<KEY>()(k);
+                                return (shift_ < 64) ? (size_t)((h * 0x9E3779B97F4A7C15ULL) >> shift_) : 0;
+                        }
+        }; /* end of NodeCache */
+} /* end of namespace */
+#endif /* __CACHE_H__ */
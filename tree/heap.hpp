@@ -0,0 +1,277 @@
+#ifndef __HEAP_H__
+#define __HEAP_H__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace trees {
+
+        /* std::vector allocator returning blocks aligned to ALIGN bytes */
+        template <typename T, size_t ALIGN> struct AlignedAllocator {
+                typedef T value_type;
+
+                template <typename U> struct rebind {
+                        typedef AlignedAllocator<U,ALIGN> other;
+                };
+
+                AlignedAllocator() { }
+                template <typename U> AlignedAllocator(const AlignedAllocator<U,ALIGN> &) { }
+
+                T * allocate(size_t n) {
+                        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(ALIGN)));
+                }
+
+                void deallocate(T * p, size_t) {
+                        ::operator delete(p, std::align_val_t(ALIGN));
+                }
+
+                template <typename U> bool operator==(const AlignedAllocator<U,ALIGN> &) const { return true; }
+                template <typename U> bool operator!=(const AlignedAllocator<U,ALIGN> &) const { return false; }
+        };
+
+        /*
+         * d-ary min heap stored in a contiguous array. Entries only hold the
+         * key and a handle; values live in a separate array indexed by
+         * handle and never move, so sifting copies 16 bytes per level with
+         * 8 byte keys. Element k has its children at ARITY * k + 1 ...
+         * ARITY * k + ARITY and the array starts with ARITY - 1 unused
+         * slots, so that the children of every node start at a multiple of
+         * ARITY: with a cache line aligned array and 16 byte entries the 4
+         * children of a 4-ary heap fill exactly one cache line, those of an
+         * 8-ary heap two adjacent ones.
+         *
+         * insertKey returns a handle that stays valid until the element is
+         * popped or erased, used by decreaseKey and erase to find the
+         * element in O(1); freed handles are reused.
+         */
+        template <typename KEY, typename VALUE, unsigned ARITY = 4> class DaryHeap {
+
+                static_assert(ARITY >= 2, "a heap needs at least two children per node");
+
+                public:
+                        typedef size_t Handle;
+
+                private:
+                        struct Entry {
+                                KEY key_;
+                                Handle handle_;
+                        };
+
+                        enum { OFFSET = ARITY - 1 };
+
+                        std::vector<Entry, AlignedAllocator<Entry,64> > heap_;
+                        std::vector<VALUE> values_;   /* by handle */
+                        std::vector<size_t> pos_;     /* by handle, index in heap_ */
+                        std::vector<Handle> free_;    /* handles to reuse */
+
+                        Entry & at(size_t k) {
+                                return heap_[k + OFFSET];
+                        }
+
+                        void place(size_t k, Entry & e) {
+                                pos_[e.handle_] = k;
+                                at(k) = std::move(e);
+                        }
+
+                        void siftUp(size_t k) {
+                                Entry e = std::move(at(k));
+                                size_t parent;
+
+                                while (k > 0) {
+                                        parent = (k - 1) / ARITY;
+                                        if (!(e.key_ < at(parent).key_))
+                                                break;
+                                        place(k, at(parent));
+                                        k = parent;
+                                }
+                                place(k, e);
+                        }
+
+                        void siftDown(size_t k) {
+                                Entry e = std::move(at(k));
+                                size_t n = size(), first, last, min, c;
+
+                                for (;;) {
+                                        first = ARITY * k + 1;
+                                        if (first >= n)
+                                                break;
+                                        last = (first + ARITY < n) ? first + ARITY : n;
+
+                                        /* smallest child, all in the same cache line */
+                                        min = first;
+                                        for (c = first + 1; c < last; c++)
+                                                if (at(c).key_ < at(min).key_)
+                                                        min = c;
+
+                                        if (!(at(min).key_ < e.key_))
+                                                break;
+                                        place(k, at(min));
+                                        k = min;
+                                }
+                                place(k, e);
+                        }
+
+                        Handle newHandle(const VALUE & v) {
+                                Handle h;
+
+                                if (!free_.empty()) {
+                                        h = free_.back();
+                                        free_.pop_back();
+                                        values_[h] = v;
+                                } else {
+                                        h = values_.size();
+                                        values_.push_back(v);
+                                        pos_.push_back(0);
+                                }
+                                return h;
+                        }
+
+                        /* remove the entry at k, moving the last one in its place */
+                        void removeAt(size_t k) {
+                                size_t last = size() - 1;
+                                Handle h = at(k).handle_;
+
+                                /* release what the value holds now, not when h is reused */
+                                values_[h] = VALUE();
+                                free_.push_back(h);
+                                if (k != last) {
+                                        place(k, at(last));
+                                        heap_.pop_back();
+                                        if ((k > 0) && (at(k).key_ < at((k - 1) / ARITY).key_))
+                                                siftUp(k);
+                                        else
+                                                siftDown(k);
+                                } else {
+                                        heap_.pop_back();
+                                }
+                        }
+
+                public:
+                        /* default constructor */
+                        DaryHeap() {
+                                heap_.resize(OFFSET);
+                        }
+
+                        /* number of elements */
+                        size_t size() const {
+                                return heap_.size() - OFFSET;
+                        }
+
+                        bool empty() const {
+                                return size() == 0;
+                        }
+
+                        /* preallocate room for n elements */
+                        void reserve(size_t n) {
+                                heap_.reserve(n + OFFSET);
+                                values_.reserve(n);
+                                pos_.reserve(n);
+                        }
+
+                        /* remove all the elements, invalidating all handles */
+                        void clear() {
+                                heap_.resize(OFFSET);
+                                values_.clear();
+                                pos_.clear();
+                                free_.clear();
+                        }
+
+                        /* insert a new element, duplicate keys are allowed */
+                        Handle insertKey(const KEY & k, const VALUE & v) {
+                                Handle h = newHandle(v);
+
+                                heap_.push_back(Entry{k, h});
+                                pos_[h] = size() - 1;
+                                siftUp(size() - 1);
+                                return h;
+                        }
+
+                        /*
+                         * insert a batch of (key, value) pairs with a bottom
+                         * up heapify, O(n + batch) instead of O(batch log n);
+                         * handles, in batch order, go to handles if not NULL
+                         */
+                        template <typename IT> void insertBatch(IT first, IT last, std::vector<Handle> * handles = NULL) {
+                                size_t n;
+                                Handle h;
+
+                                for (; first != last; ++first) {
+                                        h = newHandle(first->second);
+                                        heap_.push_back(Entry{first->first, h});
+                                        pos_[h] = size() - 1;
+                                        if (handles)
+                                                handles->push_back(h);
+                                }
+
+                                n = size();
+                                if (n < 2)
+                                        return;
+                                for (size_t k = (n - 2) / ARITY + 1; k-- > 0; )
+                                        siftDown(k);
+                        }
+
+                        /* smallest key, heap must not be empty */
+                        const KEY & minKey() {
+                                return at(0).key_;
+                        }
+
+                        /* value of the smallest key, heap must not be empty */
+                        VALUE & minValue() {
+                                return values_[at(0).handle_];
+                        }
+
+                        /* handle of the smallest key, heap must not be empty */
+                        Handle minHandle() {
+                                return at(0).handle_;
+                        }
+
+                        /* remove the smallest key */
+                        void popMin() {
+                                if (!empty())
+                                        removeAt(0);
+                        }
+
+                        /* pop up to n smallest elements in order, returns how many */
+                        size_t popN(size_t n, std::vector<std::pair<KEY,VALUE> > & out) {
+                                size_t i;
+
+                                for (i = 0; (i < n) && !empty(); i++) {
+                                        out.push_back(std::make_pair(at(0).key_, std::move(values_[at(0).handle_])));
+                                        removeAt(0);
+                                }
+                                return i;
+                        }
+
+                        /* key and value of a live handle */
+                        const KEY & key(Handle h) {
+                                return at(pos_[h]).key_;
+                        }
+
+                        VALUE & value(Handle h) {
+                                return values_[h];
+                        }
+
+                        /*
+                         * set the key of a live handle to k; sifts up for a
+                         * smaller key, down if k is actually larger
+                         */
+                        void decreaseKey(Handle h, const KEY & k) {
+                                size_t i = pos_[h];
+                                bool up = k < at(i).key_;
+
+                                at(i).key_ = k;
+                                if (up)
+                                        siftUp(i);
+                                else
+                                        siftDown(i);
+                        }
+
+                        /* remove the element of a live handle */
+                        void erase(Handle h) {
+                                removeAt(pos_[h]);
+                        }
+        };
+}
+#endif
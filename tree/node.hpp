@@ -15,6 +15,7 @@ namespace trees {
                         KEY key_;
                         VALUE value_;
                         int colour_;
+                        bool tombstone_;
                         Node<KEY,VALUE> *left_;
                         Node<KEY,VALUE> *right_;
                         Node<KEY,VALUE> *parent_;
@@ -23,6 +24,7 @@ namespace trees {
                         /* default constructor */
                         Node() {
                                 colour_ = RED;
+                                tombstone_ = false;
                                 left_   = NULL;
                                 right_  = NULL;
                                 right_  = NULL;
@@ -34,6 +36,7 @@ namespace trees {
                                 key_   = k;
                                 value_ = v;
                                 colour_= RED;
+                                tombstone_ = false;
                                 left_  = NULL;
                                 right_ = NULL;
                                 parent_= NULL;
@@ -44,12 +47,14 @@ namespace trees {
                                 key_   = node.key_;
                                 value_ = node.value_;
                                 colour_= node.colour_;
+                                tombstone_ = node.tombstone_;
                         }
 
                         /* assignment operator */
                         Node & operator=(const Node & node) {
                                 key_   = node.key_;
                                 value_ = node.value_;
+                                tombstone_ = node.tombstone_;
                                 return *this;
                         }
 
@@ -1,33 +1,171 @@
 #ifndef __RBT_H__
 #define __RBT_H__
 
+#include <vector>
 #include "bst.hpp"
+#include "cache.hpp"
 
 namespace trees {
 
         /* red black tree class definition */
         template <typename KEY, typename VALUE> class RBT : public BST<KEY,VALUE> {
 
+                private:
+                        bool lazy_;
+                        double ratio_;
+                        size_t tombstones_;
+                        NodeCache<KEY,VALUE> cache_;
+
                 public:
                         /* default constructor */
                         RBT() {
                                 BST<KEY,VALUE>();
                                 this->leaf_ = new Node<KEY,VALUE>();
                                 this->leaf_->colour_ = BLACK;
+                                lazy_ = false;
+                                ratio_ = 0.25;
+                                tombstones_ = 0;
                         }
 
                         /* deconstructor */
                         ~RBT() { }
 
+                        /*
+                         * enable/disable lazy deletion: deleteKey only marks
+                         * the node as a tombstone and the tree is rebuilt
+                         * once tombstones exceed ratio of all the nodes
+                         */
+                        void setLazyDelete(bool enable, double ratio = 0.25) {
+                                if (!enable && tombstones_ > 0)
+                                        compact();
+                                lazy_ = enable;
+                                ratio_ = ratio;
+                        }
+
+                        /* number of tombstones waiting for compaction */
+                        size_t tombstones() {
+                                return tombstones_;
+                        }
+
+                        /* drop tombstones and rebuild a balanced tree from live nodes */
+                        void compact() {
+                                std::vector<Node<KEY,VALUE> *> nodes;
+                                size_t n;
+                                int red = 0;
+
+                                nodes.reserve(this->size_ - tombstones_);
+                                collectLiveInternal(this->root_, nodes);
+                                n = nodes.size();
+                                this->size_ = n;
+                                tombstones_ = 0;
+
+                                /* nodes at the only incomplete level are red */
+                                while (((size_t)2 << red) <= n + 1)
+                                        red++;
+
+                                this->root_ = (n > 0) ? buildInternal(nodes, 0, n, NULL, 0, red) : NULL;
+                        }
+
+                        /*
+                         * enable the hot key cache with the given number of
+                         * slots (rounded up to a power of two), 0 disables it
+                         */
+                        void setCache(size_t slots) {
+                                cache_.resize(slots);
+                        }
+
+                        /* get hot key cache counters */
+                        CacheStats cacheStats() {
+                                return cache_.stats();
+                        }
+
+                        /* reset hot key cache counters */
+                        void resetCacheStats() {
+                                cache_.resetStats();
+                        }
+
+                        /* return live node with key k */
+                        Node<KEY,VALUE> * searchKey(const KEY & k) {
+                                Node<KEY,VALUE> * node;
+
+                                if (cache_.enabled()) {
+                                        node = cache_.lookup(k);
+                                        if (node != NULL)
+                                                return node;
+                                }
+
+                                node = this->searchKeyInternal(k, this->root_);
+
+                                if ((node != this->leaf_) && node->tombstone_)
+                                        node = this->leaf_;
+
+                                if (cache_.enabled())
+                                        cache_.store(k, (node != this->leaf_) ? node : NULL);
+                                return node;
+                        }
+
+                        /* find the maximum live key */
+                        Node<KEY,VALUE> * findMaxKey() {
+                                Node<KEY,VALUE> * max = BST<KEY,VALUE>::findMaxKey();
+
+                                while ((max != NULL) && max->tombstone_)
+                                        max = getPredecessor(max);
+                                return max;
+                        }
+
+                        /* find the minimum live key */
+                        Node<KEY,VALUE> * findMinKey() {
+                                Node<KEY,VALUE> * min = BST<KEY,VALUE>::findMinKey();
+
+                                while ((min != NULL) && min->tombstone_)
+                                        min = getSuccessor(min);
+                                return min;
+                        }
+
+                        /* report tree shape including tombstones and cache memory */
+                        TreeReport report() {
+                                TreeReport r = BST<KEY,VALUE>::report();
+
+                                r.bytes += cache_.bytes();
+                                return r;
+                        }
+
+                        /* traverse live nodes in key order */
+                        void traverseTree(void (*function)(Node<KEY,VALUE> *)) {
+                                traverseLiveInternal(this->root_, function);
+                        }
+
                         /* insert key */
                         void insertKey(const KEY & k, const VALUE & v) {
                                 Node<KEY,VALUE> ** node = &this->root_;
+                                Node<KEY,VALUE> * dead;
+                                size_t size;
+
+                                /* revive tombstone in place, no rebalancing needed */
+                                if (tombstones_ > 0) {
+                                        dead = this->searchKeyInternal(k, this->root_);
+                                        if ((dead != this->leaf_) && dead->tombstone_) {
+                                                dead->value_ = v;
+                                                dead->tombstone_ = false;
+                                                tombstones_--;
+                                                return;
+                                        }
+                                }
+
+                                /* an existing node with key k gets replaced */
+                                if (cache_.enabled())
+                                        cache_.invalidate(k);
 
                                 /* insert the key value in the tree */
+                                size = this->size_;
                                 this->insertKeyInternal(k, v, node, *node);
 
+                                /* replaced node keeps its colour, nothing to rebalance */
+                                if (this->size_ == size)
+                                        return;
+
                                 /* check Case 1 for tree rebalancing */
-                                rebalanceInsertCase1(this->searchKey(k));
+                                rebalanceInsertCase1(this->searchKeyInternal(k, this->root_));
                         }
 
                         /* delete a key */
@@ -38,40 +176,128 @@ namespace trees {
                                  * max k in the left branch or the
                                  * node having min k in the left.
                                  */
-                                Node<KEY,VALUE> *node = this->deleteKeyInternal(k);
-                                Node<KEY,VALUE> *parent, *child;
+                                Node<KEY,VALUE> *node, *parent, *child;
+
+                                if (lazy_) {
+                                        deleteKeyLazy(k);
+                                        return;
+                                }
+
+                                /* before the node holding k takes another key */
+                                if (cache_.enabled())
+                                        cache_.invalidate(k);
+
+                                node = this->deleteKeyInternal(k);
 
                                 /* if key not present */
                                 if (node == NULL)
                                         return;
 
+                                /* node, going to be freed, may be cached under its key */
+                                if (cache_.enabled())
+                                        cache_.invalidate(node->key_);
+
                                 child = (node->left_ != this->leaf_) ? node->left_ : node->right_;
 
-                                /* replace node with child and keep node */
+                                /*
+                                 * double black case: rebalance while node is
+                                 * still linked, so that its side is not
+                                 * ambiguous when child is the leaf sentinel
+                                 */
+                                if (node->colour_ == BLACK) {
+                                        if (child->colour_ == RED)
+                                                child->colour_ = BLACK;
+                                        else
+                                                rebalanceDeleteCase1(node);
+                                }
+
+                                /* replace node with child */
                                 parent = node->parent_;
                                 if (parent) {
                                         if (parent->left_ == node)
                                                 parent->left_ = child;
                                         else
                                                 parent->right_ = child;
-                                        child->parent_ = parent;
                                 }
+                                else
+                                        this->root_ = (child != this->leaf_) ? child : NULL;
 
-                                if (node->colour_ == BLACK) {
-                                        if (child->colour_ == RED)
-                                                child->colour_ = BLACK;
-                                        else
-                                                /* double black case */
-                                                rebalanceDeleteCase1(child);
-                                }
+                                if (child != this->leaf_)
+                                        child->parent_ = parent;
 
                                 /* eventually delete node */
                                 this->deleteNode(node);
+                                this->size_--;
+                                TREES_STAT(this->stats_.frees++);
                         }
 
                 private:
+                        /* lazy delete: mark the node and compact past the ratio */
+                        void deleteKeyLazy(const KEY & k) {
+                                Node<KEY,VALUE> * node = this->searchKeyInternal(k, this->root_);
+
+                                if ((node == this->leaf_) || node->tombstone_)
+                                        return;
+
+                                node->tombstone_ = true;
+                                tombstones_++;
+
+                                if (cache_.enabled())
+                                        cache_.invalidate(k);
+
+                                if (tombstones_ > ratio_ * this->size_)
+                                        compact();
+                        }
+
+                        /* collect live nodes in key order and free tombstones */
+                        void collectLiveInternal(Node<KEY,VALUE> * node, std::vector<Node<KEY,VALUE> *> & nodes) {
+                                if ((node == NULL) || (node == this->leaf_))
+                                        return;
+
+                                collectLiveInternal(node->left_, nodes);
+                                Node<KEY,VALUE> * right = node->right_;
+                                if (node->tombstone_) {
+                                        this->deleteNode(node);
+                                        TREES_STAT(this->stats_.frees++);
+                                }
+                                else
+                                        nodes.push_back(node);
+                                collectLiveInternal(right, nodes);
+                        }
+
+                        /* link nodes[lo, hi) into a balanced subtree */
+                        Node<KEY,VALUE> * buildInternal(std::vector<Node<KEY,VALUE> *> & nodes, size_t lo, size_t hi,
+                                                        Node<KEY,VALUE> * parent, int depth, int red) {
+                                Node<KEY,VALUE> * node;
+                                size_t mid;
+
+                                if (lo == hi)
+                                        return this->leaf_;
+
+                                mid = lo + (hi - lo) / 2;
+                                node = nodes[mid];
+                                node->parent_ = parent;
+                                node->colour_ = (depth == red) ? RED : BLACK;
+                                node->left_ = buildInternal(nodes, lo, mid, node, depth + 1, red);
+                                node->right_ = buildInternal(nodes, mid + 1, hi, node, depth + 1, red);
+                                return node;
+                        }
+
+                        /* traverse live nodes internal */
+                        void traverseLiveInternal(Node<KEY,VALUE> * node, void (*function)(Node<KEY,VALUE> *)) {
+                                if ((node == NULL) || (node == this->leaf_))
+                                        return;
+
+                                traverseLiveInternal(node->left_, function);
+                                Node<KEY,VALUE> * right = node->right_;
+                                if (!node->tombstone_)
+                                        function(node);
+                                traverseLiveInternal(right, function);
+                        }
+
                         /* Case 1: the root node is black */
                         void rebalanceInsertCase1(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.insertCase[0]++);
                                 if (node->parent_ == NULL)
                                         node->colour_ = BLACK;
                                 else
@@ -80,6 +306,7 @@ namespace trees {
 
                         /* Case 2: the parent node is black */
                         void rebalanceInsertCase2(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.insertCase[1]++);
                                 if (node->parent_->colour_ == BLACK)
                                         return;
                                 else
@@ -88,6 +315,7 @@ namespace trees {
 
                         /* Case 3: both parent and uncle are red */
                         void rebalanceInsertCase3(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.insertCase[2]++);
                                 Node<KEY,VALUE> * grandpa, * uncle = getUncle(node);
 
                                 if ((uncle != NULL) && (uncle->colour_ == RED)) {
@@ -103,6 +331,7 @@ namespace trees {
 
                         /* Case 4: parent is red and uncle is black */
                         void rebalanceInsertCase4(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.insertCase[3]++);
                                 Node<KEY,VALUE> * grandpa = getGrandParent(node);
 
                                 if ((node == node->parent_->right_) &&
@@ -121,6 +350,7 @@ namespace trees {
 
                         /* Case 5: */
                         void rebalanceInsertCase5(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.insertCase[4]++);
                                 Node<KEY,VALUE> * grandpa;
 
                                 grandpa = getGrandParent(node);
@@ -135,12 +365,14 @@ namespace trees {
 
                         /* Case 1: */
                         void rebalanceDeleteCase1(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.deleteCase[0]++);
                                  if (node->parent_ != NULL)
                                         rebalanceDeleteCase2(node);
                         }
 
                         /* Case 2: */
                         void rebalanceDeleteCase2(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.deleteCase[1]++);
                                 Node<KEY,VALUE> * sibling = getSibling(node);
 
                                 if (sibling->colour_ == RED) {
@@ -158,6 +390,7 @@ namespace trees {
 
                         /* Case 3: */
                         void rebalanceDeleteCase3(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.deleteCase[2]++);
                                  Node<KEY,VALUE> * sibling = getSibling(node);
 
                                  if ((node->parent_->colour_ == BLACK) &&
@@ -173,6 +406,7 @@ namespace trees {
 
                         /* Case 4: */
                         void rebalanceDeleteCase4(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.deleteCase[3]++);
                                 Node<KEY,VALUE> * sibling = getSibling(node);
 
                                 if ((node->parent_->colour_ == RED) &&
@@ -187,6 +421,7 @@ namespace trees {
 
                         /* Case 5: */
                         void rebalanceDeleteCase5(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.deleteCase[4]++);
                                 Node<KEY,VALUE> * sibling = getSibling(node);
 
                                 if (sibling->colour_ == BLACK) {
@@ -210,6 +445,7 @@ namespace trees {
 
                         /* Case 6: */
                         void rebalanceDeleteCase6(Node<KEY,VALUE> * node) {
+                                TREES_STAT(this->stats_.deleteCase[5]++);
                                  Node<KEY,VALUE> * sibling = getSibling(node);
 
                                  sibling->colour_ = node->parent_->colour_;
@@ -229,6 +465,7 @@ namespace trees {
                         void rotateLeft(Node<KEY,VALUE> * node) {
                                 Node<KEY,VALUE> * parent, * right_child;
 
+                                TREES_STAT(this->stats_.rotateLeft++);
                                 parent = node->parent_;
                                 right_child = node->right_;
 
@@ -253,6 +490,7 @@ namespace trees {
                         void rotateRight(Node<KEY,VALUE> * node) {
                                 Node<KEY,VALUE> * parent, * left_child;
 
+                                TREES_STAT(this->stats_.rotateRight++);
                                 parent = node->parent_;
                                 left_child = node->left_;
 
@@ -295,6 +533,26 @@ namespace trees {
                                         return grandpa->left_;
                         }
 
+                        /* get in-order successor */
+                        Node<KEY,VALUE> * getSuccessor(Node<KEY,VALUE> * node) {
+                                if (node->right_ != this->leaf_)
+                                        return this->findMinKeyInternal(node->right_);
+
+                                while ((node->parent_ != NULL) && (node->parent_->right_ == node))
+                                        node = node->parent_;
+                                return node->parent_;
+                        }
+
+                        /* get in-order predecessor */
+                        Node<KEY,VALUE> * getPredecessor(Node<KEY,VALUE> * node) {
+                                if (node->left_ != this->leaf_)
+                                        return this->findMaxKeyInternal(node->left_);
+
+                                while ((node->parent_ != NULL) && (node->parent_->left_ == node))
+                                        node = node->parent_;
+                                return node->parent_;
+                        }
+
                         /* get sibling */
                         Node<KEY,VALUE> * getSibling(Node<KEY,VALUE> * node) {
                                 if ((node == NULL) || (node->parent_ == NULL))
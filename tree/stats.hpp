@@ -0,0 +1,87 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <ostream>
+#include <vector>
+
+/*
+ * Operation counters are compiled in only when TREES_STATS is defined,
+ * otherwise TREES_STAT() expands to nothing and the trees carry no
+ * counter state at all.
+ */
+#ifdef TREES_STATS
+#define TREES_STAT(stmt) do { stmt; } while (0)
+#else
+#define TREES_STAT(stmt) do { } while (0)
+#endif
+
+namespace trees {
+
+        /* operation counters, all zero when TREES_STATS is not defined */
+        struct TreeStats {
+                size_t searches;              /* descents from the root */
+                size_t searchComparisons;     /* key comparisons during descents */
+                size_t insertComparisons;     /* key comparisons during inserts */
+                size_t rotateLeft;
+                size_t rotateRight;
+                size_t insertCase[5];         /* RBT rebalanceInsertCase1-5 hits */
+                size_t deleteCase[6];         /* RBT rebalanceDeleteCase1-6 hits */
+                size_t allocations;           /* nodes allocated */
+                size_t frees;                 /* nodes freed before destruction */
+
+                TreeStats() {
+                        searches = searchComparisons = insertComparisons = 0;
+                        rotateLeft = rotateRight = 0;
+                        for (int i = 0; i < 5; i++)
+                                insertCase[i] = 0;
+                        for (int i = 0; i < 6; i++)
+                                deleteCase[i] = 0;
+                        allocations = frees = 0;
+                }
+
+                /* write counters as a JSON object */
+                void toJson(std::ostream & os) const {
+                        os << "{\"searches\": " << searches
+                           << ", \"search_comparisons\": " << searchComparisons
+                           << ", \"insert_comparisons\": " << insertComparisons
+                           << ", \"rotate_left\": " << rotateLeft
+                           << ", \"rotate_right\": " << rotateRight
+                           << ", \"insert_case\": [";
+                        for (int i = 0; i < 5; i++)
+                                os << (i ? ", " : "") << insertCase[i];
+                        os << "], \"delete_case\": [";
+                        for (int i = 0; i < 6; i++)
+                                os << (i ? ", " : "") << deleteCase[i];
+                        os << "], \"allocations\": " << allocations
+                           << ", \"frees\": " << frees << "}";
+                }
+        };
+
+        /* shape of the tree, computed on demand by report() */
+        struct TreeReport {
+                size_t nodes;                     /* allocated nodes, tombstones included */
+                size_t tombstones;
+                size_t bytes;                     /* nodes, sentinel and cache */
+                std::vector<size_t> depth;        /* depth[d]: nodes at depth d */
+                std::vector<size_t> blackHeight;  /* blackHeight[h]: root to nil paths with h black nodes */
+
+                TreeReport() {
+                        nodes = tombstones = bytes = 0;
+                }
+
+                /* write report as a JSON object */
+                void toJson(std::ostream & os) const {
+                        os << "{\"nodes\": " << nodes
+                           << ", \"tombstones\": " << tombstones
+                           << ", \"bytes\": " << bytes
+                           << ", \"depth\": [";
+                        for (size_t i = 0; i < depth.size(); i++)
+                                os << (i ? ", " : "") << depth[i];
+                        os << "], \"black_height\": [";
+                        for (size_t i = 0; i < blackHeight.size(); i++)
+                                os << (i ? ", " : "") << blackHeight[i];
+                        os << "]}";
+                }
+        };
+} /* end of namespace */
+#endif /* __STATS_H__ */